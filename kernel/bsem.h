@@ -0,0 +1,5 @@
+// bsem_sethandoff() modes: what bsem_up() does with the waiter
+// it passes the semaphore to.
+#define BSEM_WAKE           0   // queue it at the back of this CPU's run queue
+#define BSEM_HANDOFF_QUEUE  1   // queue it at the front, to run next here
+#define BSEM_HANDOFF_YIELD  2   // queue it at the front and yield to it
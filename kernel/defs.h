@@ -9,8 +9,13 @@ struct sleeplock;
 struct stat;
 struct superblock;
 struct sigaction;
+struct siginfo;
 struct thread;
 struct Bsemaphore;
+struct bsemstat;
+struct slabcache;
+struct slabstat;
+struct kthread_attr;
 
 // bio.c
 void            binit(void);
@@ -66,6 +71,9 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            kdup(void *);
+int             krefs(void *);
+uint64          kfreepages(void);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -73,7 +81,14 @@ void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
 
+// slab.c
+void            slabinit(struct slabcache*, char*, uint);
+void*           slaballoc(struct slabcache*);
+void            slabfree(struct slabcache*, void*);
+int             slab_stat(int, struct slabstat*);
+
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
@@ -89,10 +104,15 @@ int             cpuid(void);
 void            exit(int);
 int             fork(void);
 int             growproc(int);
-void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
-void            proc_freepagetable(pagetable_t, uint64);
+void            proc_freepagetable(pagetable_t, uint64, int);
 int             kill (int, int);
+struct proc*    findproc(int);
+int             tkill(int, int);
+int             sigqueue(int, int, int);
+int             sigtimedwait(uint, uint64, int);
+void            sig_take(struct proc*, struct thread*, int, struct siginfo*);
+int             signal_pending(void);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
@@ -101,11 +121,19 @@ void            procinit(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
+void            setrunnable(struct thread*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
+void            wakeup_one(void*);
+void            setrunnable_next(struct thread*);
+void            tlb_shootdown(pagetable_t);
+int             lazyfault(pagetable_t, uint64, int);
+int             futex_wait(uint64, int);
+int             futex_wake(uint64, int);
 void            yield(void);
+void            preempt(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
@@ -115,15 +143,28 @@ int             sigaction (int, const struct sigaction *, struct sigaction *);
 void            sigret (void);
 void            handle_SIGKILL(struct proc *, int );
 void            freethread(struct thread*);
-int             kthread_create ( void ( * ) ( ) , void *);
+int             kthread_create ( void ( * ) ( ) , void *, void *);
 int             kthread_id();
 void            kthread_exit(int);
 int             kthread_join(int, int*);
+int             kthread_limit(int);
+int             kthread_detach(int);
+int             kthread_join_any(int*);
+int             kthread_run(uint64, uint64, uint64, struct kthread_attr*);
+int             setpriority(int, int);
+int             getpriority(int);
+void            ustacks_free(struct proc*, pagetable_t);
 void            kill_all_threads_besides_myself_and_wait(struct thread*);
 int             bsem_alloc();
 void            bsem_free(int);
 void            bsem_down(int);
 void            bsem_up(int);
+int             bsem_stat(int, struct bsemstat*);
+int             bsem_sethandoff(int, int);
+int             ksem_alloc(int);
+int             ksem_free(int);
+int             ksem_down(int, int);
+int             ksem_up(int, int);
 
 
 // swtch.S
@@ -162,12 +203,14 @@ void            syscall();
 
 // trap.c
 extern uint     ticks;
+extern uint64   tickcycles;
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
 void            signals_handling(struct proc *);
-void            user_signal_handlng(struct proc *p, int signum);
+void            user_signal_handlng(struct proc *p, int signum, int value);
+int             lowbit(uint);
 
 // uart.c
 void            uartinit(void);
@@ -185,10 +228,13 @@ pagetable_t     uvmcreate(void);
 void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
-int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmcopy(pagetable_t, pagetable_t, uint64, uint64);
+int             uvmcow(pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
+void            uvmunmap_lazy(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
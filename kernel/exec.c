@@ -127,15 +127,20 @@ exec(char *path, char **argv)
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
   p->sz = sz;
+  p->lazyreserved = 0;
+  p->lazyfaulted = 0;
   t->trapframe->epc = elf.entry;  // initial program counter = main
   t->trapframe->sp = sp; // initial stack pointer
-  proc_freepagetable(oldpagetable, oldsz);
+  t->trapframe->tp = 0;  // no thread-local storage block yet
+  ustacks_free(p, oldpagetable); // the other threads are gone
+  t->ustack = -1;
+  proc_freepagetable(oldpagetable, oldsz, p->ntfpages);
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
  bad:
   if(pagetable)
-    proc_freepagetable(pagetable, sz);
+    proc_freepagetable(pagetable, sz, p->ntfpages);
   if(ip){
     iunlockput(ip);
     end_op();
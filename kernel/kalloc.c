@@ -18,15 +18,41 @@ struct run {
   struct run *next;
 };
 
+// The global pool. Most kalloc()/kfree() calls are served by the
+// calling CPU's kcache below and only come here in batches.
 struct {
   struct spinlock lock;
   struct run *freelist;
+  uint64 nfree;           // pages on freelist
 } kmem;
 
+// Per-CPU caches of free pages. A CPU refills its cache from kmem
+// KCACHE_BATCH pages at a time when it runs dry, and gives a batch
+// back once it holds more than KCACHE_MAX. A CPU only looks at
+// another CPU's cache when kmem is empty too. The lock is nearly
+// always uncontended; it is there for those steals.
+#define KCACHE_BATCH 32
+#define KCACHE_MAX   (2*KCACHE_BATCH)
+
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;                  // pages on freelist
+} kcache[NCPU];
+
+// Reference counts for each physical page, so that copy-on-write
+// fork can share pages between page tables. kalloc() sets a page's
+// count to 1 and kfree() only frees it once the count drops to 0.
+// Updated with atomics rather than under a lock.
+#define PA2REF(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+int pageref[(PHYSTOP - KERNBASE) / PGSIZE];
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kcache[i].lock, "kcache");
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -35,31 +61,84 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    pageref[PA2REF(p)] = 1;
     kfree(p);
+  }
 }
 
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Drop a reference to the page of physical memory pointed at
+// by v, and free it if that was the last one. The page normally
+// should have been returned by a call to kalloc().  (The exception
+// is when initializing the allocator; see kinit above.)
 void
 kfree(void *pa)
 {
-  struct run *r;
+  struct kcache *kc;
+  struct run *r, *last;
+  int ref, i;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  if((ref = __sync_sub_and_fetch(&pageref[PA2REF(pa)], 1)) < 0)
+    panic("kfree: ref");
+  if(ref > 0)
+    return;
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  kc = &kcache[cpuid()];
+  acquire(&kc->lock);
+  r->next = kc->freelist;
+  kc->freelist = r;
+  kc->n++;
+  if(kc->n > KCACHE_MAX){
+    // give the oldest KCACHE_BATCH pages back to kmem.
+    for(last = kc->freelist, i = 1; i < kc->n - KCACHE_BATCH; i++)
+      last = last->next;
+    r = last->next;
+    last->next = 0;
+    kc->n -= KCACHE_BATCH;
+    for(last = r; last->next; last = last->next)
+      ;
+    acquire(&kmem.lock);
+    last->next = kmem.freelist;
+    kmem.freelist = r;
+    kmem.nfree += KCACHE_BATCH;
+    release(&kmem.lock);
+  }
+  release(&kc->lock);
+  pop_off();
+}
+
+// Take a page from some other CPU's cache, for when both this
+// CPU's cache and kmem are empty.
+static struct run*
+ksteal(int me)
+{
+  struct kcache *kc;
+  struct run *r;
+
+  for(int i = 1; i < NCPU; i++){
+    kc = &kcache[(me + i) % NCPU];
+    if(kc->n == 0)  // don't bother locking an empty cache
+      continue;
+    acquire(&kc->lock);
+    r = kc->freelist;
+    if(r){
+      kc->freelist = r->next;
+      kc->n--;
+    }
+    release(&kc->lock);
+    if(r)
+      return r;
+  }
+  return 0;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -68,15 +147,68 @@ kfree(void *pa)
 void *
 kalloc(void)
 {
-  struct run *r;
+  struct kcache *kc;
+  struct run *r, *last;
+  int me, n;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  push_off();
+  me = cpuid();
+  kc = &kcache[me];
+  acquire(&kc->lock);
+  if(kc->freelist == 0){
+    // refill with up to KCACHE_BATCH pages from kmem.
+    acquire(&kmem.lock);
+    r = kmem.freelist;
+    if(r){
+      for(last = r, n = 1; n < KCACHE_BATCH && last->next; n++)
+        last = last->next;
+      kmem.freelist = last->next;
+      kmem.nfree -= n;
+      last->next = 0;
+      kc->freelist = r;
+      kc->n = n;
+    }
+    release(&kmem.lock);
+  }
+  r = kc->freelist;
+  if(r){
+    kc->freelist = r->next;
+    kc->n--;
+  }
+  release(&kc->lock);
+  if(r == 0)
+    r = ksteal(me);
+  pop_off();
 
-  if(r)
+  if(r){
+    pageref[PA2REF(r)] = 1;
     memset((char*)r, 5, PGSIZE); // fill with junk
+  }
   return (void*)r;
 }
+
+// Take another reference to an allocated page.
+void
+kdup(void *pa)
+{
+  if(__sync_fetch_and_add(&pageref[PA2REF(pa)], 1) < 1)
+    panic("kdup");
+}
+
+// Number of free physical pages.
+uint64
+kfreepages(void)
+{
+  uint64 n = kmem.nfree;
+
+  for(int i = 0; i < NCPU; i++)
+    n += kcache[i].n;
+  return n;
+}
+
+// Number of references to an allocated page.
+int
+krefs(void *pa)
+{
+  return pageref[PA2REF(pa)];
+}
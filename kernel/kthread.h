@@ -0,0 +1,7 @@
+// Attributes for kthread_spawn(); a zero field means the default.
+struct kthread_attr {
+  uint64 stacksize;   // bytes of kernel-managed stack, up to TSTACKMAX
+  void *tls;          // TLS block to load into tp, or 0
+};
+
+#define TSTACKDEFAULT (64*1024)
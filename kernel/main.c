@@ -27,6 +27,7 @@ main()
     binit();         // buffer cache
     iinit();         // inode cache
     fileinit();      // file table
+    pipeinit();      // pipe object cache
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
@@ -51,10 +51,6 @@
 // in both user and kernel space.
 #define TRAMPOLINE (MAXVA - PGSIZE)
 
-// map kernel stacks beneath the trampoline,
-// each surrounded by invalid guard pages.
-#define KSTACK(p) (TRAMPOLINE - ((p)+1)* 2*PGSIZE)
-
 // User memory layout.
 // Address zero first:
 //   text
@@ -62,6 +58,21 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
-//   TRAPFRAME (p->trapframe, used by the trampoline)
+//   TSTACKS: MAXTHREAD kernel-managed thread stack regions
+//   guard page
+//   trapframe region (one page per TFPERPAGE threads, growing down)
+//   TRAPFRAME (trapframes of the first threads, used by the trampoline)
+//   SIGTRAMPOLINE (where signal handlers return, shared by all)
 //   TRAMPOLINE (the same page as in the kernel)
-#define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define SIGTRAMPOLINE (TRAMPOLINE - PGSIZE)
+#define TRAPFRAME (SIGTRAMPOLINE - PGSIZE)
+#define TRAPFRAMES (TRAPFRAME - (NTRAPFRAMEPAGES-1)*PGSIZE)
+
+// Each stack region holds a stack of up to TSTACKMAX bytes that
+// grows down from TSTACKTOP(r), and at least a guard page under
+// it. Only the part of a region within the stack's size is ever
+// mapped, a page at a time as it is touched.
+#define TSTACKMAX (1024*1024)
+#define TSTACKSLOT (TSTACKMAX + PGSIZE)
+#define TSTACKS (TRAPFRAMES - PGSIZE - MAXTHREAD*TSTACKSLOT)
+#define TSTACKTOP(r) (TSTACKS + ((uint64)(r)+1)*TSTACKSLOT)
@@ -1,4 +1,3 @@
-#define NPROC        64  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
@@ -9,13 +8,19 @@
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
 #define SIG_DFL      0     // deafult signal handling
 #define SIG_IGN      1     // ignore signal
 #define SIGKILL      9     // signal
 #define SIGSTOP      17    // signal
 #define SIGCONT      19    // signal
-#define NTHREAD      8     // maximal number of threads per proccess
+#define NTHREAD      16    // default limit on threads per process
+#define MAXTHREAD    64    // highest limit kthread_limit() can set
+#define NPRIO        4     // scheduler priority levels; 0 is the highest
+#define PRIOBOOST    30    // ticks between boosts of every thread to its base level
+#define NTRAPFRAMEPAGES 8  // user pages reserved for thread trapframes
+#define SIGQUEUEMAX  32    // signals with payloads queued per process
 #define MAX_STACK_SIZE       4000     // user stack max size
-#define MAX_BSEM     128   // the maximum number of binary semaphores is MAX_BSEM
\ No newline at end of file
+#define MAX_BSEM     128   // the maximum number of binary semaphores is MAX_BSEM
+#define MAX_CSEM     128   // the maximum number of counting semaphores
\ No newline at end of file
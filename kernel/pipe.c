@@ -7,6 +7,7 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "slab.h"
 
 #define PIPESIZE 512
 
@@ -19,6 +20,14 @@ struct pipe {
   int writeopen;  // write fd is still open
 };
 
+struct slabcache pipecache;
+
+void
+pipeinit(void)
+{
+  slabinit(&pipecache, "pipe", sizeof(struct pipe));
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,7 +37,7 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == 0)
+  if((pi = (struct pipe*)slaballoc(&pipecache)) == 0)
     goto bad;
   pi->readopen = 1;
   pi->writeopen = 1;
@@ -47,7 +56,7 @@ pipealloc(struct file **f0, struct file **f1)
 
  bad:
   if(pi)
-    kfree((char*)pi);
+    slabfree(&pipecache, pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -68,7 +77,7 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    slabfree(&pipecache, pi);
   } else
     release(&pi->lock);
 }
@@ -82,11 +91,12 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
   acquire(&pi->lock);
   while(i < n){
     if(pi->readopen == 0 || pr->killed){
+      wakeup_one(&pi->nwrite);  // we may have been the one woken
       release(&pi->lock);
       return -1;
     }
     if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
-      wakeup(&pi->nread);
+      wakeup_one(&pi->nread);
       sleep(&pi->nwrite, &pi->lock);
     } else {
       char ch;
@@ -96,7 +106,11 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       i++;
     }
   }
-  wakeup(&pi->nread);
+  wakeup_one(&pi->nread);
+  // readers and writers are woken one at a time, so pass
+  // the wakeup on if there is room left for another writer.
+  if(pi->nwrite != pi->nread + PIPESIZE)
+    wakeup_one(&pi->nwrite);
   release(&pi->lock);
 
   return i;
@@ -112,6 +126,7 @@ piperead(struct pipe *pi, uint64 addr, int n)
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
     if(pr->killed){
+      wakeup_one(&pi->nread);  // we may have been the one woken
       release(&pi->lock);
       return -1;
     }
@@ -124,7 +139,10 @@ piperead(struct pipe *pi, uint64 addr, int n)
     if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
       break;
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  wakeup_one(&pi->nwrite);  //DOC: piperead-wakeup
+  // likewise, pass the wakeup on if we left data for another reader.
+  if(pi->nread != pi->nwrite)
+    wakeup_one(&pi->nread);
   release(&pi->lock);
   return i;
 }
@@ -5,16 +5,44 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "sysinfo.h"
+#include "bsem.h"
+#include "slab.h"
+#include "kthread.h"
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// procs come from proccache as they are needed and are never
+// given back to it: freeproc() puts a proc on freeprocs for the
+// next allocproc(). code that holds a pointer to a proc it has no
+// lock on, like findproc() and the wakeups after kill(), can then
+// count on it still being a proc, with working locks.
+struct slabcache proccache;
+struct spinlock proclist_lock;
+struct proc *allprocs;         // every proc there is, through p->allnext
+struct proc *freeprocs;        // the UNUSED ones, through p->freenext
 
 struct proc *initproc;
 
+// backups of user trapframes, saved while a signal handler runs.
+struct slabcache tfcache;
+
+// struct threads, allocated as processes create more of them.
+struct slabcache threadcache;
+
+// signals queued by sigqueue(), with their payloads.
+struct slabcache sigqcache;
+
 int nextpid = 1;
 struct spinlock pid_lock;
 
+// pid -> proc, chained through p->hashnext, so finding a pid
+// doesn't mean looking at every proc. pid_lock must be held when
+// using it. lock order: p->lock, then pid_lock.
+#define NPIDHASH 64
+#define PIDHASH(pid) ((pid) % NPIDHASH)
+static struct proc *pidhash[NPIDHASH];
+
 int nexttid = 1;
 struct spinlock tid_lock;
 
@@ -23,8 +51,11 @@ extern void forkret(void);
 static void freeproc(struct proc *p);
 static struct Bsemaphore binary_semaphores[MAX_BSEM]; 
 struct spinlock binary_semaphores_lock;
+static struct Csemaphore counting_semaphores[MAX_CSEM];
+struct spinlock counting_semaphores_lock;
 
 extern char trampoline[]; // trampoline.S
+extern char sigtrampoline[]; // sigtramp.S
 
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
@@ -32,41 +63,78 @@ extern char trampoline[]; // trampoline.S
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
-void
-proc_mapstacks(pagetable_t kpgtbl) {
-  struct proc *p;  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int)(p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
-  }
-}
+// Sleep queues, hashed by wait channel, so that wakeup(chan)
+// only looks at threads that may be sleeping on chan instead
+// of every thread in the system.
+// Lock order: sq->lock, then p->lock.
+#define NSLEEPQ 64
+
+struct sleepq {
+  struct spinlock lock;
+  struct waitq q;
+} sleepq[NSLEEPQ];
 
 // initialize the proc table at boot time.
 void
 procinit(void)
 {
-  struct proc *p;
+  struct cpu *c;
 
   for (int i=0; i<MAX_BSEM; i++){
     binary_semaphores[i].descriptor =-1;
   } 
+  for (int i=0; i<MAX_CSEM; i++){
+    counting_semaphores[i].descriptor =-1;
+  }
   
   initlock(&pid_lock, "nextpid");
   initlock(&tid_lock, "nexttid");
   initlock(&wait_lock, "wait_lock");
   initlock(&binary_semaphores_lock, "binary_semaphores_lock");
+  initlock(&counting_semaphores_lock, "counting_semaphores_lock");
+
+  for(int i = 0; i < NSLEEPQ; i++)
+    initlock(&sleepq[i].lock, "sleepq");
+
+  slabinit(&tfcache, "trapframe", sizeof(struct trapframe));
+  slabinit(&threadcache, "thread", sizeof(struct thread));
+  slabinit(&sigqcache, "sigqueue", sizeof(struct sigqueued));
+  slabinit(&proccache, "proc", sizeof(struct proc));
+  initlock(&proclist_lock, "proclist");
+  if(MAXTHREAD > NTRAPFRAMEPAGES * TFPERPAGE)
+    panic("procinit: MAXTHREAD");
+
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    initlock(&c->rqlock, "runq");
+}
+
+// Make a new proc for allocproc(), with its first thread slot,
+// which is always there. Returns 0 if out of memory.
+static struct proc*
+newproc(void)
+{
+  struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    initlock(&p->lock, "proc");
-    p->threads->kstack = KSTACK((int) (p - proc));
-    //p->kstack = KSTACK((int) (p - proc));
+  if((p = slaballoc(&proccache)) == 0)
+    return 0;
+  memset(p, 0, sizeof(*p));
+  initlock(&p->lock, "proc");
+  initlock(&p->vmlock, "vm");
+  initlock(&p->joinlock, "join");
+  initlock(&p->stoplock, "stop");
+  if((p->threads[0] = slaballoc(&threadcache)) == 0){
+    slabfree(&proccache, p);
+    return 0;
   }
+  memset(p->threads[0], 0, sizeof(struct thread));
+  p->threads[0]->ustack = -1;
+  p->nthreads = 1;
+
+  acquire(&proclist_lock);
+  p->allnext = allprocs;
+  allprocs = p;
+  release(&proclist_lock);
+  return p;
 }
 
 // Must be called with interrupts disabled,
@@ -108,17 +176,306 @@ mythread(void) {
   return t;
 }
 
+// Per-CPU run queues.
+// Every T_RUNNABLE thread sits on exactly one CPU's run queue,
+// so scheduler() can pick the next thread without walking the
+// proc table or touching other processes' locks.
+// Lock order: p->lock, then c->rqlock.
+//
+// Each run queue is a multi-level feedback queue: a FIFO per
+// level, and runq_pop() takes from the highest non-empty one.
+// A thread starts at its base level, which setpriority() sets,
+// and drops a level each time it runs out its time slice there,
+// so CPU hogs sink below threads that mostly sleep. Once every
+// PRIOBOOST ticks all threads go back to their base levels so
+// that none starves: runq_boost() lifts the threads queued on a
+// CPU, and prio_refresh() resets the others when next queued.
+
+// Time slice, in ticks, of a thread at level prio.
+#define PRIOSLICE(prio) (1 << (prio))
+
+// Put t back at its base level if there has been a boost since
+// it was last reset. t->my_p->lock must be held.
+static void
+prio_refresh(struct thread *t)
+{
+  uint epoch = ticks / PRIOBOOST;
 
-int
-allocpid() {
-  int pid;
+  if(t->prioepoch != epoch){
+    t->prioepoch = epoch;
+    t->prio = t->baseprio;
+    t->prioticks = 0;
+  }
+}
+
+// Move every thread queued on c to the tail of its base level,
+// if it sits below that and c has not been boosted yet this
+// epoch. The moved threads' prio is reset by prio_refresh() when
+// they run. c->rqlock must be held. t->baseprio is read without
+// t's p->lock; setpriority() requeues the thread itself anyway.
+static void
+runq_boost(struct cpu *c)
+{
+  uint epoch = ticks / PRIOBOOST;
+  struct thread *t, *next;
+  int i, b;
+
+  if(c->rqepoch == epoch)
+    return;
+  c->rqepoch = epoch;
+  for(i = 1; i < NPRIO; i++){
+    t = c->rqhead[i];
+    c->rqhead[i] = c->rqtail[i] = 0;
+    for(; t != 0; t = next){
+      next = t->rqnext;
+      t->rqnext = 0;
+      b = t->baseprio < i ? t->baseprio : i;
+      if(c->rqtail[b])
+        c->rqtail[b]->rqnext = t;
+      else
+        c->rqhead[b] = t;
+      c->rqtail[b] = t;
+    }
+  }
+  c->rqmask = 0;
+  for(i = 0; i < NPRIO; i++)
+    if(c->rqhead[i])
+      c->rqmask |= 1 << i;
+}
+
+// Append t to the tail of its level on c's run queue.
+// t->my_p->lock must be held.
+static void
+runq_push(struct cpu *c, struct thread *t)
+{
+  int i;
+
+  prio_refresh(t);
+  i = t->prio;
+  acquire(&c->rqlock);
+  t->rqcpu = c;
+  t->rqnext = 0;
+  if(c->rqtail[i])
+    c->rqtail[i]->rqnext = t;
+  else
+    c->rqhead[i] = t;
+  c->rqtail[i] = t;
+  c->rqmask |= 1 << i;
+  c->rqlen++;
+  release(&c->rqlock);
+}
+
+// Wait until no other CPU can still be using a TLB entry for
+// pagetable that was cached before this call, e.g. after
+// write-protecting or moving one of its pages. There are no
+// inter-processor interrupts to flush remote TLBs with, but
+// trampoline.S flushes the TLB on every trap from user space, and
+// a CPU in the kernel doesn't use user mappings. So it's enough to
+// watch each CPU that is running pagetable in user mode take its
+// next trap, which the timer guarantees within a tick.
+// Only spins, so it may be called with locks held.
+void
+tlb_shootdown(pagetable_t pagetable)
+{
+  uint64 seen[NCPU];
+  int i;
+
+  __sync_synchronize(); // order the caller's PTE stores before reading upt
+  for(i = 0; i < NCPU; i++){
+    seen[i] = cpus[i].utraps;
+    __sync_synchronize();
+    if(cpus[i].upt != pagetable)
+      seen[i] = ~0ULL;
+  }
+  for(i = 0; i < NCPU; i++){
+    while(seen[i] != ~0ULL && cpus[i].utraps == seen[i])
+      ;
+  }
+}
+
+// Put t at the head of its level on c's run queue, to be
+// picked before the others there. t->my_p->lock must be held.
+static void
+runq_push_front(struct cpu *c, struct thread *t)
+{
+  int i;
+
+  prio_refresh(t);
+  i = t->prio;
+  acquire(&c->rqlock);
+  t->rqcpu = c;
+  t->rqnext = c->rqhead[i];
+  c->rqhead[i] = t;
+  if(c->rqtail[i] == 0)
+    c->rqtail[i] = t;
+  c->rqmask |= 1 << i;
+  c->rqlen++;
+  release(&c->rqlock);
+}
+
+// Remove and return the oldest thread of the highest non-empty
+// level of c's run queue, or 0 if the queue is empty.
+static struct thread*
+runq_pop(struct cpu *c)
+{
+  struct thread *t = 0;
+  int i;
+
+  if(c->rqlen == 0)  // don't bother locking an empty queue
+    return 0;
+
+  acquire(&c->rqlock);
+  runq_boost(c);
+  if(c->rqmask){
+    i = lowbit(c->rqmask);
+    t = c->rqhead[i];
+    c->rqhead[i] = t->rqnext;
+    if(c->rqhead[i] == 0){
+      c->rqtail[i] = 0;
+      c->rqmask &= ~(1 << i);
+    }
+    t->rqnext = 0;
+    t->rqcpu = 0;
+    c->rqlen--;
+  }
+  release(&c->rqlock);
+  return t;
+}
+
+// Called by an idle CPU: take the oldest thread from some
+// other CPU's run queue. Start the search at the next CPU
+// so idle harts don't all pile onto the same victim.
+static struct thread*
+runq_steal(struct cpu *c)
+{
+  struct thread *t;
+  int id = c - cpus;
+
+  for(int i = 1; i < NCPU; i++){
+    if((t = runq_pop(&cpus[(id + i) % NCPU])) != 0)
+      return t;
+  }
+  return 0;
+}
+
+// Unlink t from the run queue it sits on, if any. Returns 1 if
+// it did, 0 if t was not queued or a scheduler just popped it.
+// t->my_p->lock must be held, so t can't be re-queued meanwhile.
+static int
+runq_remove(struct thread *t)
+{
+  struct cpu *c = t->rqcpu;
+  struct thread *prev, *x;
+  int i, removed = 0;
+
+  if(c == 0)
+    return 0;
+
+  acquire(&c->rqlock);
+  if(t->rqcpu == c){ // not popped by a scheduler in the meantime
+    // a boost may have moved t off level t->prio; look at them all.
+    for(i = 0; i < NPRIO; i++){
+      prev = 0;
+      for(x = c->rqhead[i]; x != 0 && x != t; x = x->rqnext)
+        prev = x;
+      if(x == t)
+        break;
+    }
+    if(i == NPRIO)
+      panic("runq_remove");
+    if(prev)
+      prev->rqnext = t->rqnext;
+    else
+      c->rqhead[i] = t->rqnext;
+    if(c->rqtail[i] == t)
+      c->rqtail[i] = prev;
+    if(c->rqhead[i] == 0)
+      c->rqmask &= ~(1 << i);
+    c->rqlen--;
+    t->rqnext = 0;
+    t->rqcpu = 0;
+    removed = 1;
+  }
+  release(&c->rqlock);
+  return removed;
+}
+
+// Mark t runnable and queue it on this CPU's run queue.
+// t->my_p->lock must be held.
+void
+setrunnable(struct thread *t)
+{
+  t->state = T_RUNNABLE;
+  runq_push(mycpu(), t);
+}
+
+// Like setrunnable(), but t goes ahead of everything else
+// queued on this CPU. For handing off to a thread that the
+// caller is about to block on or yield to.
+void
+setrunnable_next(struct thread *t)
+{
+  t->state = T_RUNNABLE;
+  runq_push_front(mycpu(), t);
+}
+
+
+// give p a new pid and enter it in pidhash.
+// p->lock must be held.
+void
+allocpid(struct proc *p) {
+  struct proc **pp;
   
   acquire(&pid_lock);
-  pid = nextpid;
+  p->pid = nextpid;
   nextpid = nextpid + 1;
+  pp = &pidhash[PIDHASH(p->pid)];
+  p->hashnext = *pp;
+  *pp = p;
   release(&pid_lock);
+}
 
-  return pid;
+// take p out of pidhash before its pid is cleared.
+// p->lock must be held.
+static void
+freepid(struct proc *p)
+{
+  struct proc **pp;
+
+  acquire(&pid_lock);
+  for(pp = &pidhash[PIDHASH(p->pid)]; *pp; pp = &(*pp)->hashnext){
+    if(*pp == p){
+      *pp = p->hashnext;
+      break;
+    }
+  }
+  release(&pid_lock);
+  p->hashnext = 0;
+}
+
+// Return the proc with the given pid, with p->lock held,
+// or 0 if there is none.
+struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  if(pid <= 0)
+    return 0;
+  acquire(&pid_lock);
+  for(p = pidhash[PIDHASH(pid)]; p != 0 && p->pid != pid; p = p->hashnext)
+    ;
+  release(&pid_lock);
+  if(p == 0)
+    return 0;
+
+  // it may have been freed, or even reused, since we let go of pid_lock.
+  acquire(&p->lock);
+  if(p->pid != pid || p->state == UNUSED){
+    release(&p->lock);
+    return 0;
+  }
+  return p;
 }
 
 int
@@ -133,32 +490,79 @@ alloctid() {
   return tid;
 }
 
-// Look in the threads table of the given proc for an UNUSED thread.
+// Add a thread slot to p, and a trapframe page if the new slot's
+// trapframe lies past the mapped part of the region.
+// p->lock must be held.
+static struct thread*
+growthreads(struct proc *p)
+{
+  struct thread *t;
+  int i = p->nthreads, pg = i / TFPERPAGE;
+  char *mem;
+
+  if(i >= MAXTHREAD)
+    return 0;
+  if(pg >= p->ntfpages){
+    if((mem = kalloc()) == 0)
+      return 0;
+    acquire(&p->vmlock);
+    if(mappages(p->pagetable, TRAPFRAME - pg*PGSIZE, PGSIZE,
+                (uint64)mem, PTE_R | PTE_W) < 0){
+      release(&p->vmlock);
+      kfree(mem);
+      return 0;
+    }
+    release(&p->vmlock);
+    p->tfpages[pg] = mem;
+    p->ntfpages++;
+  }
+  if((t = slaballoc(&threadcache)) == 0)
+    return 0;
+  memset(t, 0, sizeof(*t));
+  t->slot = i;
+  t->ustack = -1;
+  p->threads[i] = t;
+  p->nthreads++;
+  return t;
+}
+
+// Look in the threads table of the given proc for an UNUSED thread,
+// or add a slot to it if all are in use, up to p->maxthreads.
 // If found, initialize state required to run in the kernel,
 // entered and return with p->lock held, unless there was a problen and then - releasing the lock.
 // If there are no free threads, or a memory allocation fails, return 0.
 struct thread*
 allocthread(struct proc *p)
 {
-  struct thread *t;
-
-  for(t = p->threads; t < &p->threads[NTHREAD]; t++) {
-    if(t->state == T_UNUSED) {
-      goto found;
+  struct thread *t, *free = 0;
+  int i, live = 0;
+
+  // a zombie that may still be joined keeps its slot, and its exit
+  // status, until join() frees it.
+  for(i = 0; i < p->nthreads; i++) {
+    t = p->threads[i];
+    if(t->state == T_UNUSED || (t->state == T_ZOMBIE && t->detached)) {
+      if(free == 0)
+        free = t;
+    } else if(t->state != T_ZOMBIE) {
+      live++;
     }
-    else if (t->state == T_ZOMBIE){
+  }
+  if(live >= p->maxthreads){
+    release(&p->lock);
+    return 0;
+  }
+  if((t = free) != 0){
+    if(t->state == T_ZOMBIE)
       freethread(t);
-      goto found;
-    }
+  } else if((t = growthreads(p)) == 0){
+    release(&p->lock);
+    return 0;
   }
-  release(&p->lock);
-  
-
-  return 0;
 
-found:
-  //check if not first and if not first allocate kstack
-  if(t != p->threads){
+  //a slot keeps its kstack and trapframe backup after its thread
+  //is freed, so a slot that was used before needs no allocation.
+  if(t->kstack == 0){
     if( (t->kstack = (uint64)kalloc()) == 0){
       freethread(t);
       release(&p->lock);
@@ -170,8 +574,20 @@ found:
   t->tid = alloctid();
   t->state = T_USED;
   t->my_p = p;
-
-  if ((t->user_trap_frame_backup = (struct trapframe*) kalloc()) == 0){
+  t->ustack = -1;
+  t->detached = 0;
+  t->pending_signals = 0;
+  t->signal_mask = 0;
+  t->signal_mask_backup = 0;
+  t->handling_signal_counter = 0;
+  t->prio = t->baseprio = 0;
+  t->prioticks = 0;
+  t->prioepoch = ticks / PRIOBOOST;
+  t->trapframe = (struct trapframe *)(p->tfpages[t->slot / TFPERPAGE] +
+                                      (t->slot % TFPERPAGE) * sizeof(struct trapframe));
+
+  if (t->user_trap_frame_backup == 0 &&
+      (t->user_trap_frame_backup = (struct trapframe*) slaballoc(&tfcache)) == 0){
     freethread(t);
     release(&p->lock);
     
@@ -188,59 +604,46 @@ found:
   return t;
 }
 
-// Look in the process table for an UNUSED proc.
-// If found, initialize state required to run in the kernel,
+// Take an UNUSED proc off freeprocs, or make a new one.
+// Initialize state required to run in the kernel,
 // and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
+// If a memory allocation fails, return 0.
 struct proc*
 allocproc(void)
 {
   struct proc *p;
-  struct thread *t;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
-    }
-  }
-  
-  return 0;
+  acquire(&proclist_lock);
+  if((p = freeprocs) != 0)
+    freeprocs = p->freenext;
+  release(&proclist_lock);
+  if(p == 0 && (p = newproc()) == 0)
+    return 0;
 
-found:
-  p->pid = allocpid();
+  acquire(&p->lock);
+  allocpid(p);
   p->state = USED;
 
   //dealing with signals inheritence 
   p->pending_signals=0; //initializing the pending signals array with no signals (0)
-  p->signal_mask=0;
   p->stopped=0;
   p->handling_signals = 0;
-  p->handling_signal_counter = 0;
   for (int i_signal=0; i_signal<32; i_signal++){
     p->signal_handlers[i_signal]= (void *)SIG_DFL;
     p->signal_handlers_maskes[i_signal] = -1;
   }
-  // Allocate a trapframe page for all of the threads of the process
-  //memset(&p->threads, 0, sizeof(p->threads));
-  for(t = p->threads; t < &p->threads[NTHREAD]; t++) {
-    t->state = T_UNUSED;
-  }
+  // freeproc() left only the first thread slot.
+  p->threads[0]->state = T_UNUSED;
+  p->maxthreads = NTHREAD;
 
-  //kalloc for all the processes threads 
-  uint64 start_of_trapframes_address = (uint64)kalloc();
-  if (start_of_trapframes_address==0){
+  // Allocate the first trapframe page; growthreads() adds more.
+  if((p->tfpages[0] = kalloc()) == 0){
     freeproc(p);
     release(&p->lock);
     
     return 0;
   }
-
-  for(t = p->threads; t < &p->threads[NTHREAD]; t++) {
-    t->trapframe = (struct trapframe *) (start_of_trapframes_address + (uint64)((t-p->threads) * sizeof(struct trapframe)));
-  }
+  p->ntfpages = 1;
 
         // An empty user page table.
   p->pagetable = proc_pagetable(p);
@@ -255,23 +658,24 @@ found:
 }
 
 
-// free a thread structure and the data hanging from it,
+// free a thread structure. its kstack and trapframe backup stay
+// with the slot for the next allocthread(); freeproc() releases them.
 // p->lock must be held.
 void
 freethread(struct thread *t)
 {
+  struct proc *p = t->my_p;
 
-  if(t != t->my_p->threads){
-    if(t->kstack){
-      kfree((void*)t->kstack);
-    }
-    t->kstack=0;
-  }
+  if(t->state == T_RUNNABLE)
+    runq_remove(t);
 
-  if(t->user_trap_frame_backup){
-    kfree((void*)t->user_trap_frame_backup);
+  // its stack region's pages stay mapped for the next thread there.
+  if(t->ustack >= 0){
+    acquire(&p->vmlock);
+    p->stackmap &= ~(1L << t->ustack);
+    release(&p->vmlock);
   }
-  t->user_trap_frame_backup = 0;
+  t->ustack = -1;
 
   t->tid = 0;
   t->name[0] = 0;
@@ -292,21 +696,43 @@ freeproc(struct proc *p)
 {
   //first freeing all !UNUSED threads of the process
   struct thread *t;
+  int i;
 
-  if(p->threads->trapframe)
-    kfree((void*)p->threads->trapframe);
-  p->threads->trapframe = 0;
-
-  for(t = p->threads; t < &p->threads[NTHREAD]; t++) {
+  // drop every slot but the first, and what they all cached.
+  for(i = 0; i < p->nthreads; i++) {
+    t = p->threads[i];
     if(t->state != T_UNUSED) {
       freethread(t);
     }
+    t->trapframe = 0;
+    if(t->user_trap_frame_backup){
+      slabfree(&tfcache, t->user_trap_frame_backup);
+    }
+    t->user_trap_frame_backup = 0;
+    if(t->kstack){
+      kfree((void*)t->kstack);
+    }
+    t->kstack = 0;
+    if(i != 0){
+      slabfree(&threadcache, t);
+      p->threads[i] = 0;
+    }
   }
+  p->nthreads = 1;
 
-  if(p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
+  if(p->pagetable){
+    ustacks_free(p, p->pagetable);
+    proc_freepagetable(p->pagetable, p->sz, p->ntfpages);
+  }
   p->pagetable = 0;
+  for(i = 0; i < p->ntfpages; i++){
+    kfree(p->tfpages[i]);
+    p->tfpages[i] = 0;
+  }
+  p->ntfpages = 0;
   p->sz = 0;
+  if(p->pid)
+    freepid(p);
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
@@ -317,9 +743,12 @@ freeproc(struct proc *p)
 
   //dealing with the signals fields
   p->pending_signals = 0;
-  p->signal_mask =0;
-  p->signal_mask_backup =0;
-  p->handling_signal_counter=0;     // counts how many signals we are handling
+  while(p->sigq){
+    struct sigqueued *q = p->sigq;
+    p->sigq = q->next;
+    slabfree(&sigqcache, q);
+  }
+  p->nsigq = 0;
   p->handling_signals = 0;
   
   for (int i_signal=0; i_signal<32; i_signal++){
@@ -327,12 +756,19 @@ freeproc(struct proc *p)
     p->signal_handlers_maskes[i_signal] = 0;
   }   
   p->stopped = 0;
+
+  // whoever holds p->lock lets go of it before allocproc() can
+  // take p again.
+  acquire(&proclist_lock);
+  p->freenext = freeprocs;
+  freeprocs = p;
+  release(&proclist_lock);
 }
 
 //
 // Creates a new thread within the context of the calling
 // process.
-int kthread_create ( void ( *start_func ) ( ) , void *stack ){
+int kthread_create ( void ( *start_func ) ( ) , void *stack , void *tls ){
   
   struct thread *t = mythread();
   struct thread *nt;
@@ -348,7 +784,10 @@ int kthread_create ( void ( *start_func ) ( ) , void *stack ){
 
   nt->trapframe->epc = (uint64)start_func; //should we use copyin? casting?
   nt->trapframe->sp = (uint64)(stack) + MAX_STACK_SIZE - 16; // keep the 16? the STACK_SIZE? 
-  nt->state=T_RUNNABLE;
+  nt->trapframe->tp = (uint64)tls; // thread-local storage block, or 0 for none yet
+  nt->signal_mask = t->signal_mask;
+  nt->prio = nt->baseprio = t->baseprio;
+  setrunnable(nt);
   //t->context.ra = (uint64)usertrapret;
 
 
@@ -356,6 +795,82 @@ int kthread_create ( void ( *start_func ) ( ) , void *stack ){
   return nt->tid;
 }
 
+//
+// Creates a new thread on a kernel-managed stack: a region of
+// its own, faulted in lazily, with unmapped pages under it.
+// The thread starts at entry with fn and arg in a0 and a1;
+// kthread_spawn() in user space passes a wrapper that calls
+// fn(arg) and exits with its return value.
+//
+int kthread_run(uint64 entry, uint64 fn, uint64 arg, struct kthread_attr *attr){
+  struct thread *t = mythread();
+  struct thread *nt;
+  struct proc *p = myproc();
+  uint64 size, old;
+  int r;
+
+  size = attr->stacksize ? PGROUNDUP(attr->stacksize) : TSTACKDEFAULT;
+  if(size > TSTACKMAX){
+    return -1;
+  }
+
+  acquire(&p->lock);
+  if((nt = allocthread(p)) == 0){
+    return -1; // allocthread released p->lock
+  }
+  for(r = 0; r < MAXTHREAD && (p->stackmap & (1L << r)); r++)
+    ;
+  if(r == MAXTHREAD){
+    freethread(nt);
+    release(&p->lock);
+    return -1;
+  }
+  acquire(&p->vmlock);
+  old = p->stacksize[r];
+  p->stacksize[r] = size;
+  p->stackmap |= 1L << r;
+  if(r >= p->nstacks)
+    p->nstacks = r + 1;
+  release(&p->vmlock);
+  nt->ustack = r;
+
+  // a bigger stack used this region before; unmap what is now guard.
+  if(old > size){
+    uvmunmap_lazy(p->pagetable, TSTACKTOP(r) - old, (old - size) / PGSIZE, 1);
+  }
+
+  *(nt->trapframe) = *(t->trapframe);
+  nt->trapframe->epc = entry;
+  nt->trapframe->a0 = fn;
+  nt->trapframe->a1 = arg;
+  nt->trapframe->sp = TSTACKTOP(r);
+  nt->trapframe->tp = (uint64)attr->tls;
+  nt->trapframe->ra = 0;
+  nt->signal_mask = t->signal_mask;
+  nt->prio = nt->baseprio = t->baseprio;
+  setrunnable(nt);
+  release(&p->lock);
+
+  // nobody may still use those pages, but a CPU could cache them.
+  if(old > size){
+    tlb_shootdown(p->pagetable);
+  }
+  return nt->tid;
+}
+
+// Unmap and free every page of p's kernel-managed stacks in
+// pagetable, and forget the regions, e.g. when p exits or execs.
+void
+ustacks_free(struct proc *p, pagetable_t pagetable)
+{
+  if(p->nstacks > 0){
+    uvmunmap_lazy(pagetable, TSTACKS, p->nstacks * TSTACKSLOT / PGSIZE, 1);
+  }
+  p->stackmap = 0;
+  p->nstacks = 0;
+  memset(p->stacksize, 0, sizeof(p->stacksize));
+}
+
 //
 // returns the caller thread’s id
 //
@@ -373,6 +888,95 @@ int kthread_id(){
   return tid;
 }
 
+//
+// sets the calling process's limit on live threads to n, if n > 0,
+// and returns the old limit. fails if n is above MAXTHREAD or below
+// the number of threads the process already has.
+//
+int kthread_limit(int n){
+  struct proc *p = myproc();
+  int old, live = 0;
+
+  if(n > MAXTHREAD){
+    return -1;
+  }
+  acquire(&p->lock);
+  for(int i = 0; i < p->nthreads; i++) {
+    if(p->threads[i]->state != T_UNUSED && p->threads[i]->state != T_ZOMBIE){
+      live++;
+    }
+  }
+  old = p->maxthreads;
+  if(n > 0){
+    if(n < live){
+      release(&p->lock);
+      return -1;
+    }
+    p->maxthreads = n;
+  }
+  release(&p->lock);
+  return old;
+}
+
+// the live thread tid of p, or 0 if there is none.
+// p->lock must be held.
+static struct thread*
+findthread(struct proc *p, int tid)
+{
+  struct thread *t;
+
+  for(int i = 0; i < p->nthreads; i++){
+    t = p->threads[i];
+    if(t->tid == tid && t->state != T_UNUSED && t->state != T_ZOMBIE)
+      return t;
+  }
+  return 0;
+}
+
+//
+// sets the base scheduler level of thread tid of the calling
+// process, or of the caller if tid is 0, to prio, and moves the
+// thread to that level now. 0 is the highest of NPRIO levels;
+// threads made by fork() and kthread_create() inherit the level.
+//
+int setpriority(int tid, int prio){
+  struct proc *p = myproc();
+  struct thread *t;
+
+  if(prio < 0 || prio >= NPRIO){
+    return -1;
+  }
+  acquire(&p->lock);
+  if((t = tid == 0 ? mythread() : findthread(p, tid)) == 0){
+    release(&p->lock);
+    return -1;
+  }
+  t->prio = t->baseprio = prio;
+  t->prioticks = 0;
+  // requeue it at its new level, unless a scheduler has it already.
+  if(t->state == T_RUNNABLE && runq_remove(t))
+    setrunnable(t);
+  release(&p->lock);
+  return 0;
+}
+
+//
+// returns the base scheduler level of thread tid of the calling
+// process, or of the caller if tid is 0.
+//
+int getpriority(int tid){
+  struct proc *p = myproc();
+  struct thread *t;
+  int prio = -1;
+
+  acquire(&p->lock);
+  if((t = tid == 0 ? mythread() : findthread(p, tid)) != 0){
+    prio = t->baseprio;
+  }
+  release(&p->lock);
+  return prio;
+}
+
 //
 // checks if a thread is the last thread of a process in one of theses states:
 // running, runnable, used, sleeping
@@ -381,7 +985,8 @@ int kthread_id(){
 int check_if_last( struct thread *t){
   struct proc *p = t->my_p;
   struct thread *ot;
-  for(ot = p->threads; ot < &p->threads[NTHREAD]; ot++) {
+  for(int i = 0; i < p->nthreads; i++) {
+    ot = p->threads[i];
     if(ot != t){
       if((ot->state==T_RUNNABLE) | (ot->state==T_RUNNING) | (ot->state==T_SLEEPING) | (ot->state==T_USED)){
         return 0; //given thread is not last
@@ -412,21 +1017,26 @@ void kthread_exit(int status){
 
 
   else{ //if not last -  change our selves to ZOMBIE anf update xstatus (only the current thread)
-    acquire(&wait_lock);
-    wakeup(t);
+    // joiners can't look at the threads between this wakeup and
+    // our becoming a zombie, since both happen under joinlock.
+    acquire(&p->joinlock);
+    wakeup(&p->joinlock);
     acquire(&p->lock);
     t->xstate = status;
     t->state = T_ZOMBIE;
+    // signals we never took go back to p, for another thread.
+    p->pending_signals |= t->pending_signals;
+    t->pending_signals = 0;
 
     if(check_if_last(t)){  // if last - exit the process after ending all we need to do
                     // checking again to support parallel run and assuring exit() will be executed.
       release(&p->lock);
-      release(&wait_lock);
+      release(&p->joinlock);
       exit(status);
     }
 
     //release(&p->lock);
-    release(&wait_lock);
+    release(&p->joinlock);
     // Jump into the scheduler, never to return.
     sched();
     panic("zombie thread exit");
@@ -434,41 +1044,74 @@ void kthread_exit(int status){
 }
 
 
-int join(int thread_id){
+//
+// waits for a thread of the calling process to exit and frees it:
+// the thread thread_id, or with thread_id 0 any thread that is not
+// detached. threads sleep on p->joinlock, which every exiting
+// thread wakes, rather than on the thread they wait for.
+// returns the id of the thread freed and sets *xstate to its exit
+// status, or returns -1 if there is no such thread or we were killed.
+//
+static int join(int thread_id, int *xstate){
   struct thread *t = mythread();
   struct proc *p = t->my_p;
-  struct thread *t_to_wait_for;
-
-  acquire(&wait_lock);
-
-  acquire(&p->lock);
-
-  for(t_to_wait_for = p->threads; t_to_wait_for < &p->threads[NTHREAD]; t_to_wait_for++) {
-    if(t_to_wait_for != t){
-      while(t_to_wait_for->tid == thread_id){ // found the thread we were looking for
-        if(t_to_wait_for->state == T_ZOMBIE){
-          freethread(t_to_wait_for);
-          release(&p->lock);
-          release(&wait_lock);
-          return t_to_wait_for->xstate;
-        }
-        if(t->killed){
-          release(&p->lock);
-          release(&wait_lock);
-          return -199;
-        }
+  struct thread *ot;
+  int found, tid;
 
-        //found the thread but it is not ZOMBIE! therefore sleeping on it.
-        release(&p->lock);
-        sleep(t_to_wait_for, &wait_lock);  
-        acquire(&p->lock); 
-      }
+  acquire(&p->joinlock);
+  for(;;){
+    acquire(&p->lock);
+    found = 0;
+    for(int i = 0; i < p->nthreads; i++) {
+      ot = p->threads[i];
+      if(ot == t || ot->tid == 0 || ot->detached){
+        continue;
+      }
+      if(thread_id != 0 && ot->tid != thread_id){
+        continue;
+      }
+      found = 1;
+      if(ot->state == T_ZOMBIE){
+        tid = ot->tid;
+        *xstate = ot->xstate;
+        freethread(ot);
+        release(&p->lock);
+        release(&p->joinlock);
+        return tid;
+      }
+    }
+    release(&p->lock);
+    if(!found || t->killed){
+      release(&p->joinlock);
+      return -1;
+    }
+    sleep(&p->joinlock, &p->joinlock);
+  }
+}
+
+//
+// marks the thread thread_id as detached: nobody joins it, and its
+// slot is free to reuse as soon as it exits (at once if it has).
+//
+int kthread_detach(int thread_id){
+  struct proc *p = myproc();
+  struct thread *ot;
+
+  acquire(&p->lock);
+  for(int i = 0; i < p->nthreads; i++) {
+    ot = p->threads[i];
+    if(thread_id != 0 && ot->tid == thread_id && !ot->detached){
+      if(ot->state == T_ZOMBIE){
+        freethread(ot);
+      } else {
+        ot->detached = 1;
+      }
+      release(&p->lock);
+      return 0;
     }
   }
-  //didn't find the required thread (does not exist)
   release(&p->lock);
-  release(&wait_lock);
-  return -199;
+  return -1;
 }
 
 
@@ -479,8 +1122,9 @@ int join(int thread_id){
 //
 int kthread_join(int thread_id, int* status){
   struct proc *p = myproc();
-  int xstate = join(thread_id);
-  if (xstate == -199){
+  int xstate;
+
+  if(thread_id == 0 || join(thread_id, &xstate) < 0){
     return -1;
   }
 
@@ -494,6 +1138,28 @@ int kthread_join(int thread_id, int* status){
   return 0;
 }
 
+//
+// like kthread_join(), but for whichever joinable thread exits
+// first. returns its id.
+//
+int kthread_join_any(int* status){
+  struct proc *p = myproc();
+  int tid, xstate;
+
+  if((tid = join(0, &xstate)) < 0){
+    return -1;
+  }
+
+  acquire(&p->lock);
+  if(status != 0 && copyout(p->pagetable, (uint64)status, (char *)&xstate,
+                                sizeof(xstate)) < 0) { //if copyout status failed
+    release(&p->lock);
+    return -1;
+  }
+  release(&p->lock);
+  return tid;
+}
+
 
 
 // Create a user page table for a given process,
@@ -517,25 +1183,42 @@ proc_pagetable(struct proc *p)
     uvmfree(pagetable, 0);
     return 0;
   }
-  
-  // map the trapframe just below TRAMPOLINE, for trampoline.S.
-  if(mappages(pagetable, TRAPFRAME, PGSIZE,
-              (uint64)(p->threads->trapframe), PTE_R | PTE_W) < 0){
+
+  // map the code signal handlers return to just below it.
+  // user code runs it, so PTE_U, but can't write it.
+  if(mappages(pagetable, SIGTRAMPOLINE, PGSIZE,
+              (uint64)sigtrampoline, PTE_R | PTE_X | PTE_U) < 0){
     uvmunmap(pagetable, TRAMPOLINE, 1, 0);
     uvmfree(pagetable, 0);
     return 0;
   }
+  
+  // map the trapframe pages from just below SIGTRAMPOLINE down,
+  // for trampoline.S.
+  for(int i = 0; i < p->ntfpages; i++){
+    if(mappages(pagetable, TRAPFRAME - i*PGSIZE, PGSIZE,
+                (uint64)(p->tfpages[i]), PTE_R | PTE_W) < 0){
+      if(i > 0)
+        uvmunmap(pagetable, TRAPFRAME - (i-1)*PGSIZE, i, 0);
+      uvmunmap(pagetable, SIGTRAMPOLINE, 1, 0);
+      uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+      uvmfree(pagetable, 0);
+      return 0;
+    }
+  }
 
   return pagetable;
 }
 
 // Free a process's page table, and free the
-// physical memory it refers to.
+// physical memory it refers to. ntfpages trapframe
+// pages are mapped below SIGTRAMPOLINE.
 void
-proc_freepagetable(pagetable_t pagetable, uint64 sz)
+proc_freepagetable(pagetable_t pagetable, uint64 sz, int ntfpages)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
-  uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, SIGTRAMPOLINE, 1, 0);
+  uvmunmap(pagetable, TRAPFRAME - (ntfpages-1)*PGSIZE, ntfpages, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -575,7 +1258,7 @@ userinit(void)
   p->cwd = namei("/");
 
   p->state = RUNNABLE;
-  t->state = T_RUNNABLE;
+  setrunnable(t);
 
   release(&p->lock);
 }
@@ -586,23 +1269,105 @@ int
 growproc(int n)
 {
   
-  uint sz;
+  uint64 sz, va, nres, ntouched;
   struct proc *p = myproc();
+  pte_t *pte;
   acquire(&p->lock); // our code
+  acquire(&p->vmlock);
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+    // only reserve the memory; lazyfault() maps each page
+    // the first time it is touched.
+    if(sz + n >= TSTACKS) {
+      release(&p->vmlock);
       release(&p->lock);
       return -1;
     }
+    p->lazyreserved += (PGROUNDUP(sz + n) - PGROUNDUP(sz)) / PGSIZE;
+    sz += n;
   } else if(n < 0){
+    if(-n > sz) {
+      release(&p->vmlock);
+      release(&p->lock);
+      return -1;
+    }
+    // sbrk()'s reserved pages are the top of the heap, so they
+    // are the first to go; count the ones that had been touched.
+    nres = (PGROUNDUP(sz) - PGROUNDUP(sz + n)) / PGSIZE;
+    if(nres > p->lazyreserved)
+      nres = p->lazyreserved;
+    ntouched = 0;
+    for(va = PGROUNDUP(sz) - nres * PGSIZE; va < PGROUNDUP(sz); va += PGSIZE){
+      if((pte = walk(p->pagetable, va, 0)) != 0 && (*pte & PTE_V))
+        ntouched++;
+    }
+    p->lazyreserved -= nres;
+    p->lazyfaulted -= ntouched < p->lazyfaulted ? ntouched : p->lazyfaulted;
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
   p->sz = sz;
+  release(&p->vmlock);
   release(&p->lock); // our code
   return 0;
 }
 
+// Is va in the heap, or within the size of a kernel-managed
+// stack in use?
+static int
+lazyva(struct proc *p, uint64 va)
+{
+  int r;
+
+  if(va < p->sz)
+    return 1;
+  if(va < TSTACKS || va >= TSTACKTOP(MAXTHREAD-1))
+    return 0;
+  r = (va - TSTACKS) / TSTACKSLOT;
+  return (p->stackmap & (1L << r)) && va >= TSTACKTOP(r) - p->stacksize[r];
+}
+
+// Map a zeroed page at va if it lies in memory that sbrk() has
+// reserved for the current process, or in a thread's stack,
+// but nobody has touched yet.
+// Called for page faults and by copyin()/copyout(). Threads that
+// fault on the same page at once each allocate one, and the first
+// to install it wins. Returns 0 if va is now mapped and allows the
+// access (write or read), -1 if it isn't a lazy page.
+int
+lazyfault(pagetable_t pagetable, uint64 va, int write)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+  char *mem;
+  int r = -1;
+
+  if(p == 0 || pagetable != p->pagetable || !lazyva(p, va))
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+
+  acquire(&p->vmlock);
+  if(lazyva(p, va) && (pte = walk(pagetable, va, 1)) != 0){
+    if((*pte & PTE_V) == 0){
+      *pte = PA2PTE(mem) | PTE_W|PTE_X|PTE_R|PTE_U|PTE_V;
+      mem = 0;
+      if(va < p->sz)
+        p->lazyfaulted++;
+    }
+    // mapped now, by us or by another thread; the guard
+    // page below the stack is mapped too, but not for users.
+    if((*pte & PTE_U) && (!write || (*pte & PTE_W)))
+      r = 0;
+  }
+  release(&p->vmlock);
+
+  if(mem)
+    kfree(mem);
+  return r;
+}
+
 // Create a new process, copying the parent.
 // Sets up child kernel stack to return as if from fork() system call.
 int
@@ -621,16 +1386,38 @@ fork(void)
   }
   //np = nt->my_p;
   if((nt = allocthread(np)) == 0){
+    // allocthread() let go of np->lock.
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
     return -1;
   }
 
-  // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  // Copy user memory from parent to child, and the stack of
+  // this thread if the kernel manages it; the child's thread
+  // keeps running on it, in the same region.
+  if(t->ustack >= 0){
+    int r = t->ustack;
+    np->stackmap = 1L << r;
+    np->nstacks = r + 1;
+    np->stacksize[r] = p->stacksize[r];
+    nt->ustack = r;
+    if(uvmcopy(p->pagetable, np->pagetable,
+               TSTACKTOP(r) - TSTACKMAX, TSTACKTOP(r)) < 0){
+      freeproc(np);
+      release(&np->lock);
+      return -1;
+    }
+  }
+  if(uvmcopy(p->pagetable, np->pagetable, 0, p->sz) < 0){
     freeproc(np);
     release(&np->lock);
     return -1;
   }
   np->sz = p->sz;
+  np->maxthreads = p->maxthreads;
+  np->lazyreserved = p->lazyreserved;
+  np->lazyfaulted = p->lazyfaulted;
 
   // copy saved user registers.
   *(nt->trapframe) = *(t->trapframe);
@@ -638,7 +1425,8 @@ fork(void)
   // Cause fork to return 0 in the child.
   nt->trapframe->a0 = 0;
   //for signals inheritence
-  np->signal_mask =p->signal_mask;
+  nt->signal_mask = t->signal_mask;
+  nt->prio = nt->baseprio = t->baseprio;
   for (int i_signal=0; i_signal<32; i_signal++){
     np->signal_handlers[i_signal] = p->signal_handlers[i_signal];
     np->signal_handlers_maskes[i_signal] = p->signal_handlers_maskes[i_signal];
@@ -660,11 +1448,17 @@ fork(void)
 
   acquire(&wait_lock);
   np->parent = p;
+  np->sibling = p->children;
+  p->children = np;
   release(&wait_lock);
 
+  // our other threads may be running in user space with
+  // writable TLB entries for pages the child now shares.
+  tlb_shootdown(p->pagetable);
+
   acquire(&np->lock);
   np->state = RUNNABLE;
-  nt->state = T_RUNNABLE;
+  setrunnable(nt);
   release(&np->lock);
 
   return pid;
@@ -675,13 +1469,17 @@ fork(void)
 void
 reparent(struct proc *p)
 {
-  struct proc *pp;
+  struct proc *pp, *last = 0;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
-    }
+  for(pp = p->children; pp; pp = pp->sibling){
+    pp->parent = initproc;
+    last = pp;
+  }
+  if(last){
+    last->sibling = initproc->children;
+    initproc->children = p->children;
+    p->children = 0;
+    wakeup(initproc);
   }
 }
 
@@ -689,33 +1487,52 @@ reparent(struct proc *p)
 //
 //
 void kill_all_threads_besides_myself_and_wait( struct thread *t){
-  //go in loop 
-  // change t->killed=1
-  // another loop to wait for each thread to wait (join?) 
+  // mark every other live thread killed (again, in case one was
+  // just created) until they are all zombies, then free them,
+  // detached or not. only the first thread to get here does
+  // that; one that comes later, e.g. each thread of a process
+  // hit by SIGKILL calling exit(), just exits as a thread, or
+  // the two would keep waking each other forever.
 
   struct proc *p = t->my_p;
   struct thread *ot;
-  acquire(&p->lock);
-  for(ot = p->threads; ot < &p->threads[NTHREAD]; ot++) {
-    if(ot->tid != t->tid && ot->tid != 0){
+  int live;
 
-      if((ot->state==T_RUNNABLE) | (ot->state==T_RUNNING) | (ot->state==T_SLEEPING) | (ot->state==T_USED)){
-       ot->killed = 1; //given thread is not last
-       if((ot->state==T_SLEEPING)){
-          ot->state = T_RUNNABLE;
-       }
+  acquire(&p->joinlock);
+  if(p->exiting){
+    release(&p->joinlock);
+    kthread_exit(-1);
+  }
+  p->exiting = 1;
+  acquire(&p->lock);
+  for(;;){
+    live = 0;
+    for(int i = 0; i < p->nthreads; i++) {
+      ot = p->threads[i];
+      if(ot != t && ((ot->state==T_RUNNABLE) | (ot->state==T_RUNNING) | (ot->state==T_SLEEPING) | (ot->state==T_USED))){
+        ot->killed = 1;
+        if(ot->state==T_SLEEPING){
+          setrunnable(ot);
+        }
+        live++;
       }
     }
+    if(live == 0){
+      break;
+    }
+    release(&p->lock);
+    sleep(&p->joinlock, &p->joinlock);
+    acquire(&p->lock);
   }
-  
-  for(ot = p->threads; ot < &p->threads[NTHREAD]; ot++) {
-    if(ot->tid != t->tid && ot->tid != 0){
-      release(&p->lock);
-      join(ot->tid); 
-      acquire(&p->lock);
+  for(int i = 0; i < p->nthreads; i++) {
+    ot = p->threads[i];
+    if(ot != t && ot->state == T_ZOMBIE){
+      freethread(ot);
     }
   }
+  p->exiting = 0; // exec() goes on with just this thread
   release(&p->lock);
+  release(&p->joinlock);
 }
 
 // Exit the current process.  Does not return.
@@ -752,7 +1569,6 @@ exit(int status)
 
   // Parent might be sleeping in wait().
   wakeup(p->parent);
-  wakeup(t);
   
   acquire(&p->lock);
 
@@ -772,37 +1588,36 @@ exit(int status)
 int
 wait(uint64 addr)
 {
-  struct proc *np;
+  struct proc *np, **npp;
   int havekids, pid;
   struct proc *p = myproc();
 
   acquire(&wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(np = proc; np < &proc[NPROC]; np++){
-      if(np->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&np->lock);
-
-        havekids = 1;
-        if(np->state == ZOMBIE){
-          // Found one.
-          pid = np->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-            release(&np->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(np);
+    // Scan through our children looking for exited ones.
+    havekids = p->children != 0;
+    for(npp = &p->children; (np = *npp) != 0; npp = &np->sibling){
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&np->lock);
+
+      if(np->state == ZOMBIE){
+        // Found one.
+        pid = np->pid;
+        if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
+                                sizeof(np->xstate)) < 0) {
           release(&np->lock);
           release(&wait_lock);
-          return pid;
+          return -1;
         }
+        *npp = np->sibling;
+        np->sibling = 0;
+        freeproc(np);
         release(&np->lock);
+        release(&wait_lock);
+        return pid;
       }
+      release(&np->lock);
     }
 
     // No point waiting if we don't have any children.
@@ -819,10 +1634,12 @@ wait(uint64 addr)
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
-//  - swtch to start running that process.
-//  - eventually that process transfers control
+//  - take a thread off this CPU's run queue, or steal
+//    one from another CPU if the local queue is empty.
+//  - swtch to start running that thread.
+//  - eventually that thread transfers control
 //    via swtch back to the scheduler.
+// Run queues hand out threads by priority; see runq_pop().
 void
 scheduler(void)
 {
@@ -835,30 +1652,31 @@ scheduler(void)
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-
-        for(t = p->threads; t < &p->threads[NTHREAD]; t++) {
-          if (t->state == T_RUNNABLE){
-            
-            t->state = T_RUNNING;
-            c->proc = p;
-            c->thread = t;
-            swtch(&c->context, &t->context);
-            // Process is done running for now.
-            // It should have changed its p->state before coming back.
-            c->proc = 0;
-            c->thread = 0;
-          }
-        }
-      }
-      release(&p->lock);
+    if((t = runq_pop(c)) == 0 && (t = runq_steal(c)) == 0)
+      continue;
+
+    // The thread was queued without our help, so re-check it
+    // under its process's lock before running it.
+    p = t->my_p;
+    if(p == 0)
+      continue;
+    acquire(&p->lock);
+    if(t->my_p == p && t->state == T_RUNNABLE) {
+      // Switch to chosen thread.  It is the thread's job
+      // to release its process's lock and then reacquire it
+      // before jumping back to us.
+      prio_refresh(t);
+      t->slice = 0;
+      t->state = T_RUNNING;
+      c->proc = p;
+      c->thread = t;
+      swtch(&c->context, &t->context);
+      // Thread is done running for now.
+      // It should have changed its t->state before coming back.
+      c->proc = 0;
+      c->thread = 0;
     }
+    release(&p->lock);
   }
 }
 
@@ -899,7 +1717,36 @@ yield(void)
   struct thread *t= mythread();
   acquire(&p->lock);
   //p->state = RUNNABLE;
-  t->state = T_RUNNABLE;
+  setrunnable(t);
+  sched();
+  release(&p->lock);
+}
+
+// Called on a timer interrupt by the thread it interrupted.
+// Charge the tick to the thread's level, and move it down a
+// level once it has run for a whole time slice there. Give up
+// the CPU when the slice is over, or sooner if a thread of a
+// higher level is waiting on this CPU.
+void
+preempt(void)
+{
+  struct proc *p = myproc();
+  struct thread *t = mythread();
+  int over;
+
+  acquire(&p->lock);
+  prio_refresh(t);
+  t->slice++;
+  over = t->slice >= PRIOSLICE(t->prio);
+  if(++t->prioticks >= PRIOSLICE(t->prio) && t->prio < NPRIO-1){
+    t->prio++;
+    t->prioticks = 0;
+  }
+  if(!over && (mycpu()->rqmask & ((1 << t->prio) - 1)) == 0){
+    release(&p->lock);
+    return;
+  }
+  setrunnable(t);
   sched();
   release(&p->lock);
 }
@@ -924,61 +1771,202 @@ forkret(void)
   usertrapret();
 }
 
-// Atomically release lock and sleep on chan.
-// Reacquires lock when awakened.
-// switch to thread sleeping rather then process
-void
-sleep(void *chan, struct spinlock *lk)
+// Return the sleep queue that threads sleeping on chan use.
+static struct sleepq*
+sleepq_of(void *chan)
+{
+  uint64 h = (uint64)chan;
+
+  h = (h >> 3) ^ (h >> 11) ^ (h >> 19);
+  return &sleepq[h % NSLEEPQ];
+}
+
+// Append t to q.
+static void
+waitq_push(struct waitq *q, struct thread *t)
+{
+  t->wq = q;
+  t->wqnext = 0;
+  t->wqprev = q->tail;
+  if(q->tail)
+    q->tail->wqnext = t;
+  else
+    q->head = t;
+  q->tail = t;
+}
+
+// Unlink t from q.
+static void
+waitq_remove(struct waitq *q, struct thread *t)
+{
+  if(t->wqprev)
+    t->wqprev->wqnext = t->wqnext;
+  else
+    q->head = t->wqnext;
+  if(t->wqnext)
+    t->wqnext->wqprev = t->wqprev;
+  else
+    q->tail = t->wqprev;
+  t->wq = 0;
+  t->wqnext = 0;
+  t->wqprev = 0;
+}
+
+// Sleep on chan, which hashes to sq. sq->lock must be held; it
+// is released once we are queued. Whoever wakes chan has to take
+// sq->lock first, so a caller that checked its condition under
+// sq->lock can't miss the wakeup.
+static void
+sleepq_wait(struct sleepq *sq, void *chan)
 {
   struct proc *p = myproc();
   struct thread *t = mythread();
-  
-  // Must acquire p->lock in order to
-  // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
-  // so it's okay to release lk.
 
+  // Must acquire p->lock in order to
+  // change t->state and then call sched.
   acquire(&p->lock);  //DOC: sleeplock1
-  release(lk);
 
   // Go to sleep.
-  //p->chan = chan;
   t->chan = chan;
-  //p->state = SLEEPING;
   t->state = T_SLEEPING;
+  waitq_push(&sq->q, t);
+  release(&sq->lock);
 
   sched();
 
   // Tidy up.
-  //p->chan = 0;
   t->chan = 0;
+  release(&p->lock);
+
+  // wakeup() takes us off the queue itself, but anything
+  // else that makes us runnable (e.g. a kill) does not.
+  if(t->wq){
+    acquire(&sq->lock);
+    if(t->wq)
+      waitq_remove(t->wq, t);
+    release(&sq->lock);
+  }
+}
+
+// Atomically release lock and sleep on chan.
+// Reacquires lock when awakened.
+// switch to thread sleeping rather then process
+void
+sleep(void *chan, struct spinlock *lk)
+{
+  struct sleepq *sq = sleepq_of(chan);
+
+  // Once we hold chan's sleep queue lock we can be
+  // guaranteed that we won't miss any wakeup (wakeup
+  // locks the queue), so it's okay to release lk.
+  acquire(&sq->lock);
+  release(lk);
+
+  sleepq_wait(sq, chan);
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
-// Wake up all processes sleeping on chan.
-// Must be called without any p->lock.
-void
-wakeup(void *chan)
+// Wake up to n threads sleeping on chan, oldest first;
+// n < 0 wakes them all. Returns the number woken.
+static int
+wakeup_n(void *chan, int n)
 {
+  struct sleepq *sq = sleepq_of(chan);
+  struct thread *t, *next;
   struct proc *p;
-  struct thread *t;
+  int woken = 0;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock); //our code
-    if(p->state == RUNNABLE) {
-      for(t = p->threads; t < &p->threads[NTHREAD]; t++) {
-        if ((t->state == T_SLEEPING) & (t->chan == chan)){
-          t->state = T_RUNNABLE;
-        }
-      }
+  acquire(&sq->lock);
+  for(t = sq->q.head; t != 0 && woken != n; t = next){
+    next = t->wqnext;
+    if(t->chan != chan)
+      continue;
+    p = t->my_p;
+    acquire(&p->lock);
+    if(t->state == T_SLEEPING && t->chan == chan){
+      waitq_remove(&sq->q, t);
+      setrunnable(t);
+      woken++;
     }
     release(&p->lock);
   }
+  release(&sq->lock);
+  return woken;
+}
+
+// Wake up all threads sleeping on chan.
+// Must be called without any p->lock.
+void
+wakeup(void *chan)
+{
+  wakeup_n(chan, -1);
+}
+
+// Wake up the thread that has slept on chan the longest.
+// For waiters that each consume the whole condition, where
+// waking everyone would just send the rest back to sleep.
+// Must be called without any p->lock.
+void
+wakeup_one(void *chan)
+{
+  wakeup_n(chan, 1);
+}
+
+// Resolve user address uaddr to the key that futex waiters on it
+// sleep on, or 0 if it isn't an aligned word of the heap or of a
+// thread stack. The key is built from the page table and the
+// address rather than the physical address, since a copy-on-write
+// fault can move the page between a wait and the matching wake.
+// Page tables live above KERNBASE, so keys are far above any
+// kernel address used as a sleep channel.
+static uint64
+futex_key(uint64 uaddr)
+{
+  struct proc *p = myproc();
+
+  if(uaddr % sizeof(int) != 0 || !lazyva(p, uaddr))
+    return 0;
+  return ((uint64)p->pagetable / PGSIZE) << 36 | uaddr / sizeof(int);
+}
+
+// Sleep on user word uaddr if it still holds val. The check
+// is made under the sleep queue lock, so a futex_wake() that
+// follows a store to *uaddr can't slip in between. Returns 0
+// once woken, -1 if *uaddr != val or the caller was killed.
+int
+futex_wait(uint64 uaddr, int val)
+{
+  struct proc *p = myproc();
+  struct thread *t = mythread();
+  struct sleepq *sq;
+  uint64 key;
+  int cur;
+
+  if((key = futex_key(uaddr)) == 0)
+    return -1;
+  sq = sleepq_of((void*)key);
+  acquire(&sq->lock);
+  if(copyin(p->pagetable, (char*)&cur, uaddr, sizeof(cur)) < 0 ||
+     cur != val || p->killed || t->killed){
+    release(&sq->lock);
+    return -1;
+  }
+  sleepq_wait(sq, (void*)key);
+  return 0;
+}
+
+// Wake up to n threads sleeping on user word uaddr; n < 0 wakes
+// them all. Returns the number woken.
+int
+futex_wake(uint64 uaddr, int n)
+{
+  uint64 key;
+
+  if((key = futex_key(uaddr)) == 0)
+    return -1;
+  return wakeup_n((void*)key, n);
 }
 
 void 
@@ -986,13 +1974,208 @@ handle_SIGKILL(struct proc *p, int signum){
   p->pending_signals = ( p->pending_signals  | (1<<signum) );
   p->killed = 1;
   struct thread *t;
-  for(t = p->threads; t < &p->threads[NTHREAD]; t++) {
+  for(int i = 0; i < p->nthreads; i++) {
+    t = p->threads[i];
     if(t->state == T_SLEEPING){
       // Wake process from sleep() ao it will know it needs to die
-      t->state = T_RUNNABLE;
+      setrunnable(t);
+      break;
+    }
+  }
+}
+
+// Does t sleep where a signal will end its sleep? sleep() and
+// sigtimedwait() sleep on &ticks and look for signals each tick;
+// other sleeps (pipes, wait(), joins, semaphores) don't.
+static int
+sig_interruptible(struct thread *t)
+{
+  return t->state == T_SLEEPING && t->chan == &ticks;
+}
+
+// The thread to take a signal sent to p as a whole: one that
+// does not block it, preferring one in an interruptible sleep,
+// then one waiting to run, then one running now, so a dedicated
+// signal thread takes it and busy workers are left alone. A
+// thread in any other sleep comes last, since it won't see the
+// signal until something else wakes it. 0 if every thread
+// blocks it. p->lock must be held.
+static struct thread*
+signal_target(struct proc *p, int signum)
+{
+  struct thread *t, *runnable = 0, *running = 0, *sleeping = 0;
+
+  for(int i = 0; i < p->nthreads; i++){
+    t = p->threads[i];
+    if(t->killed || (t->signal_mask & (1<<signum)))
+      continue;
+    if(sig_interruptible(t))
+      return t;
+    if(t->state == T_SLEEPING && sleeping == 0)
+      sleeping = t;
+    if(t->state == T_RUNNABLE && runnable == 0)
+      runnable = t;
+    if(t->state == T_RUNNING && running == 0)
+      running = t;
+  }
+  if(runnable)
+    return runnable;
+  return running ? running : sleeping;
+}
+
+// send signum to p, or to its thread t if t is not 0.
+// a signal sent to p is blocked only if every thread blocks it.
+// returns 1 if it continued or killed p, so its threads must be
+// woken with stop_wakeup() once p->lock is released.
+// p->lock must be held.
+static int
+post_signal(struct proc *p, struct thread *t, int signum)
+{
+  int blocked;
+
+  if(t != 0)
+    blocked = (t->signal_mask & (1<<signum)) != 0;
+  else
+    blocked = signal_target(p, signum) == 0;
+
+  if((signum == SIGKILL) | (p->signal_handlers[signum] == (void *)SIGKILL)){
+    if(!blocked){
+      handle_SIGKILL(p, signum);
+      return 1;
+    }
+  }
+  
+  
+  // blocked, it stays pending, for sigtimedwait() to take or to
+  // kill p once a thread unblocks it.
+  else if ( (signum!=SIGSTOP) & (signum!=SIGCONT) & (p->signal_handlers[signum] == (void *)SIG_DFL) & !blocked){
+    handle_SIGKILL(p, signum);
+    return 1;
+  }
+  
+  
+  //handlling case cont got before stop - therefore not turnning it on. 
+  else if (signum==SIGSTOP) {
+    p->stopped=1; //handle sigstop
+  }
+
+  else if ((p->signal_handlers[signum] == (void *)SIGSTOP)){
+    if(!blocked){
+      p->stopped=1; //handle sigstop
+    }
+  }  
+
+  else if( ((signum==SIGCONT) & (p->signal_handlers[signum] == (void *)SIG_DFL)) | (p->signal_handlers[signum] == (void *)SIGCONT)){
+    if(!blocked && p->stopped){
+      p->stopped=0; //handle sigcont
+      return 1;
+    }
+  }
+  // with no thread that will see it soon, leave it with p, so
+  // whichever thread not blocking it gets back to user space first
+  // takes it.
+  else if(t == 0 && ((t = signal_target(p, signum)) == 0 ||
+                    (t->state == T_SLEEPING && !sig_interruptible(t)))){
+    p->pending_signals = ( p->pending_signals  | (1<<signum) );//turnning on signal bit
+  }
+  else{
+    t->pending_signals = ( t->pending_signals  | (1<<signum) );
+  }
+  return 0;
+}
+
+// wake p's threads parked in handling_stop_cont(), after
+// post_signal() continued or killed p. p->lock must not be held.
+static void
+stop_wakeup(struct proc *p)
+{
+  acquire(&p->stoplock);
+  wakeup(&p->stopped);
+  release(&p->stoplock);
+}
+
+// is signum pending on p or any of its threads?
+// p->lock must be held.
+static int
+sig_ispending(struct proc *p, int signum)
+{
+  if(p->pending_signals & (1<<signum))
+    return 1;
+  for(int i = 0; i < p->nthreads; i++)
+    if(p->threads[i]->pending_signals & (1<<signum))
+      return 1;
+  return 0;
+}
+
+// post signum to p, or to its thread t if t is not 0, and release
+// p->lock. q is a sigqueue()'d instance or 0; it goes on p->sigq
+// if the signal was left pending, and is freed if not. then wake
+// whoever the signal concerns.
+static void
+send_signal(struct proc *p, struct thread *t, int signum, struct sigqueued *q)
+{
+  struct sigqueued **qp;
+  int wake, waiters;
+
+  wake = post_signal(p, t, signum);
+  if(q != 0 && sig_ispending(p, signum)){
+    for(qp = &p->sigq; *qp; qp = &(*qp)->next)
+      ;
+    *qp = q;
+    p->nsigq++;
+    q = 0;
+  }
+  waiters = p->sigwaiters;
+  release(&p->lock);
+
+  if(q != 0)
+    slabfree(&sigqcache, q);
+  if(wake)
+    stop_wakeup(p);
+  if(waiters){
+    // threads in sigtimedwait() sleep on ticks, like sleep().
+    acquire(&tickslock);
+    wakeup(&ticks);
+    release(&tickslock);
+  }
+}
+
+// take signum, which is pending on t or else on p, and fill in
+// *info. an instance that sigqueue() sent comes off p->sigq with
+// its payload; if more of them are queued signum stays pending,
+// on p, so none is lost. p->lock must be held.
+void
+sig_take(struct proc *p, struct thread *t, int signum, struct siginfo *info)
+{
+  struct sigqueued **qp, *q;
+  int more = 0;
+
+  if(t->pending_signals & (1<<signum))
+    t->pending_signals &= ~(1<<signum);
+  else
+    p->pending_signals &= ~(1<<signum);
+
+  info->si_signo = signum;
+  info->si_value = 0;
+  info->si_pid = 0;
+  for(qp = &p->sigq; *qp; qp = &(*qp)->next){
+    if((*qp)->info.si_signo == signum){
+      q = *qp;
+      *info = q->info;
+      *qp = q->next;
+      p->nsigq--;
+      slabfree(&sigqcache, q);
+      break;
+    }
+  }
+  for(q = *qp; q; q = q->next){
+    if(q->info.si_signo == signum){
+      more = 1;
       break;
     }
   }
+  if(more)
+    p->pending_signals |= 1<<signum;
 }
 
 // our code 
@@ -1004,66 +2187,141 @@ kill(int pid, int signum)
     return -1;
   }
   struct proc *p;
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      if(p->state==UNUSED){ //no reason to signal a process that is unused
-        return -1;
-      }
-      if(p->signal_handlers[signum] != (void *)SIG_IGN){
-        if((signum == SIGKILL) | (p->signal_handlers[signum] == (void *)SIGKILL)){
-          if(!(p->signal_mask & (1<<signum))){
-            handle_SIGKILL(p, signum);
-            //p->signal_mask = p->signal_mask_backup;
-          }
-        }
-        
-        
-        else if ( (signum!=SIGSTOP) & (signum!=SIGCONT) & (p->signal_handlers[signum] == (void *)SIG_DFL)){
-          if(!(p->signal_mask & (1<<signum))){
-            handle_SIGKILL(p, signum);
-            //p->signal_mask = p->signal_mask_backup;
-          }
-        }
-        
-        
-        //handlling case cont got before stop - therefore not turnning it on. 
-        else if (signum==SIGSTOP) {
-          p->handling_signal_counter++;
-          p->stopped=1; //handle sigstop
-        }
+  if((p = findproc(pid)) == 0){ //no such process, or it is unused
+    return -1;
+  }
+  if(p->signal_handlers[signum] == (void *)SIG_IGN){
+    release(&p->lock);
+    return -1;
+  }
+  send_signal(p, 0, signum, 0);
+  return 0;
+}
 
-        else if ((p->signal_handlers[signum] == (void *)SIGSTOP)){
-          if(!(p->signal_mask & (1<<signum))){
-            p->handling_signal_counter++;
-            p->stopped=1; //handle sigstop
-            if (p->handling_signal_counter == 1){
-              p->signal_mask_backup = p->signal_mask;
-            }
-            p->signal_mask = p->signal_handlers_maskes[signum];
-          }
-        }  
-
-        else if( ((signum==SIGCONT) & (p->signal_handlers[signum] == (void *)SIG_DFL)) | (p->signal_handlers[signum] == (void *)SIGCONT)){
-          if(!((p->signal_mask & (1<<signum)))){
-            if (p->stopped == 1){
-              p->handling_signal_counter--; //for end dealing with the stop signal
-              p->signal_mask = p->signal_mask_backup;
-                
-            } 
-            p->stopped=0; //handle sigcont
-          }
-        }
-        else{
-          p->pending_signals = ( p->pending_signals  | (1<<signum) );//turnning on signal bit
-        }
-        release(&p->lock);
-        return 0;
-      }
+// send signum to the thread tid of the calling process. what a
+// signal does to a whole process, like SIGKILL and SIGSTOP, it
+// still does to the whole process; a handler runs on tid.
+int
+tkill(int tid, int signum)
+{
+  struct proc *p = myproc();
+  struct thread *t;
+
+  if ((signum < 0) | (signum > 31) | (tid <= 0) ){
+    return -1;
+  }
+  acquire(&p->lock);
+  if((t = findthread(p, tid)) == 0){
+    release(&p->lock);
+    return -1;
+  }
+  if(p->signal_handlers[signum] != (void *)SIG_IGN)
+    send_signal(p, t, signum, 0);
+  else
+    release(&p->lock);
+  return 0;
+}
+
+// like kill(), but each signal sent is queued with value, so
+// repeated signals are not merged into one and the handler or
+// sigtimedwait() gets the value. fails if pid already has
+// SIGQUEUEMAX queued.
+int
+sigqueue(int pid, int signum, int value)
+{
+  struct proc *p;
+  struct sigqueued *q;
+
+  if ((signum < 0) | (signum > 31) | (pid <= 0) ){
+    return -1;
+  }
+  if((q = slaballoc(&sigqcache)) == 0)
+    return -1;
+  q->next = 0;
+  q->info.si_signo = signum;
+  q->info.si_value = value;
+  q->info.si_pid = myproc()->pid;
+
+  if((p = findproc(pid)) == 0){
+    slabfree(&sigqcache, q);
+    return -1;
+  }
+  if(p->nsigq >= SIGQUEUEMAX){
+    release(&p->lock);
+    slabfree(&sigqcache, q);
+    return -1;
+  }
+  if(p->signal_handlers[signum] != (void *)SIG_IGN){
+    send_signal(p, 0, signum, q);
+  } else {
+    release(&p->lock);
+    slabfree(&sigqcache, q);
+  }
+  return 0;
+}
+
+// wait up to timeout ticks, or for ever if timeout < 0, for one of
+// the signals in set to be pending for the calling thread, and take
+// it without running its handler. the thread should block them, so
+// that no handler takes them first. copies out what it took to
+// uinfo if not 0 and returns the signal, or returns -1 on timeout,
+// if killed, or if another signal with a handler is pending.
+int
+sigtimedwait(uint set, uint64 uinfo, int timeout)
+{
+  struct proc *p = myproc();
+  struct thread *t = mythread();
+  struct siginfo info;
+  uint ready, ticks0;
+  int signum = -1;
+
+  set &= ~((1<<SIGKILL) | (1<<SIGSTOP));
+  if(set == 0)
+    return -1;
+
+  // senders wake ticks if p->sigwaiters is set, holding tickslock.
+  acquire(&tickslock);
+  ticks0 = ticks;
+  acquire(&p->lock);
+  for(;;){
+    ready = p->pending_signals | t->pending_signals;
+    if(ready & set){
+      signum = lowbit(ready & set);
+      sig_take(p, t, signum, &info);
+      break;
     }
+    if(p->killed || t->killed || (ready & ~t->signal_mask))
+      break;
+    if(timeout >= 0 && ticks - ticks0 >= timeout)
+      break;
+    p->sigwaiters++;
     release(&p->lock);
+    sleep(&ticks, &tickslock);
+    acquire(&p->lock);
+    p->sigwaiters--;
   }
-  return -1; //if pid is not in the range of our pids we'll fall here
+  release(&p->lock);
+  release(&tickslock);
+
+  if(signum >= 0 && uinfo != 0 &&
+     copyout(p->pagetable, uinfo, (char *)&info, sizeof(info)) < 0)
+    return -1;
+  return signum;
+}
+
+// does the calling thread have a signal it does not block?
+// a sleep that should end for a signal can check this.
+int
+signal_pending(void)
+{
+  struct proc *p = myproc();
+  struct thread *t = mythread();
+  int r;
+
+  acquire(&p->lock);
+  r = ((p->pending_signals | t->pending_signals) & ~t->signal_mask) != 0;
+  release(&p->lock);
+  return r;
 }
 
 //function that receieves a mask and returns 1 if valid 
@@ -1086,14 +2344,14 @@ uint
 sigprocmask(uint sigmask)
 {
   struct proc *p = myproc();
-  acquire(&p->lock); //not neccesary now, but seems right fot threads.
-  uint oldsigmask=p->signal_mask;
+  struct thread *t = mythread();
+  acquire(&p->lock); // kill() reads the masks to pick a thread.
+  uint oldsigmask=t->signal_mask;
   if (check_valid_mask(sigmask)==-1){ //results in error and leaves the sig mask as it is. 
     release(&p->lock);
     return oldsigmask;
   }
-  p->signal_mask=sigmask;
-  //p->signal_mask=(p->signal_mask | sigmask)); 
+  t->signal_mask=sigmask;
   release(&p->lock);
   return oldsigmask;   
 
@@ -1191,7 +2449,7 @@ procdump(void)
   char *state;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
+  for(p = allprocs; p != 0; p = p->allnext){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -1199,6 +2457,7 @@ procdump(void)
     else
       state = "???";
     printf("%d %s %s", p->pid, state, p->name);
+    printf(" lazy %d/%d", (int)p->lazyfaulted, (int)p->lazyreserved);
     printf("\n");
   }
 }
@@ -1225,9 +2484,12 @@ int bsem_alloc(){
   release(&binary_semaphores_lock);
   if (descriptor != -1){
     binary_semaphores[descriptor].free=1;
-    for (int j=0; j<(NPROC * NTHREAD); j++){
-      binary_semaphores[descriptor].threasd_array[j]=0;
-    }
+    binary_semaphores[descriptor].owner = 0;
+    binary_semaphores[descriptor].handoff = BSEM_WAKE;
+    binary_semaphores[descriptor].spins = 0;
+    binary_semaphores[descriptor].sleeps = 0;
+    binary_semaphores[descriptor].waiters.head = 0;
+    binary_semaphores[descriptor].waiters.tail = 0;
     initlock(&binary_semaphores[descriptor].lock, "binary_semaphores_array_lock");
   }
   return descriptor;
@@ -1245,26 +2507,79 @@ void bsem_free(int descriptor){
   release(&binary_semaphores_lock);
 }
 
+// How long bsem_down() spins, in rdtime cycles, waiting for a
+// holder that is running on another CPU before going to sleep.
+// About the cost of a sleep/wakeup round trip.
+#define BSEM_SPIN 2000
+
+// Is the semaphore held by a thread that is running on another
+// CPU, and so likely to release it soon? Reads without locks, so
+// it is only a hint.
+static int
+bsem_owner_running(struct Bsemaphore *sem, struct thread *t)
+{
+  struct thread *o = sem->owner;
+
+  return o != 0 && o != t && o->state == T_RUNNING;
+}
+
 /*
 Attempt to acquire (lock) the semaphore, in case that it is already acquired (locked),
 block the current thread until it is unlocked and then acquire it.
 */
 void bsem_down(int descriptor){
   struct proc *p = myproc();
+  struct thread *t = mythread();
   struct Bsemaphore *sem = &binary_semaphores[descriptor];
+  uint64 start = 0;
   acquire(&sem->lock);
-  if(sem->free == 0){ //the semaphore is locked
-    struct thread *t = mythread();
-    int index = (p - proc) * NTHREAD + (t - p->threads);
-    sem->threasd_array[index] = t;
-    acquire(&p->lock);
-    t->state= T_SLEEPING;
+  for(;;){
+    if(sem->free){ // the semaphore is unlocked
+      sem->free = 0;
+      sem->owner = t;
+      if(start)
+        sem->spins++;
+      release(&sem->lock);
+      return;
+    }
+    if(p->killed || t->killed){ // don't block on it; we're on our way out
+      release(&sem->lock);
+      return;
+    }
+    // spin only while the holder is running elsewhere and no
+    // one is queued; with waiters, it goes to them first anyway.
+    if(sem->waiters.head || !bsem_owner_running(sem, t))
+      break;
+    if(start == 0)
+      start = r_time();
+    else if(r_time() - start >= BSEM_SPIN)
+      break;
     release(&sem->lock);
-    sched();
-    release(&p->lock);
+    while(r_time() - start < BSEM_SPIN){
+      __sync_synchronize();
+      if(sem->free || !bsem_owner_running(sem, t))
+        break;
+    }
+    acquire(&sem->lock);
   }
-  else{// the semaphore is unlocked
-    sem->free = 0;
+
+  // the semaphore is locked: queue up behind the earlier waiters.
+  // bsem_up() hands the semaphore directly to the head of the
+  // queue, so it is never up for grabs while anyone is waiting.
+  sem->sleeps++;
+  acquire(&p->lock);
+  waitq_push(&sem->waiters, t);
+  t->state = T_SLEEPING;
+  release(&sem->lock);
+  sched();
+  release(&p->lock);
+
+  // bsem_up() took us off the queue and we own the semaphore now,
+  // unless something else (a kill) woke us first.
+  if(t->wq){
+    acquire(&sem->lock);
+    if(t->wq)
+      waitq_remove(t->wq, t);
     release(&sem->lock);
   }
 }
@@ -1276,19 +2591,208 @@ is not required to be starvation free
 */
 void bsem_up(int descriptor){
   struct Bsemaphore *sem = &binary_semaphores[descriptor];
+  struct thread *t;
+  struct proc *p;
+  int handoff = BSEM_WAKE;
   acquire(&sem->lock);
-  for (int j=0; j<(NPROC * NTHREAD); j++){
-    if (sem->threasd_array[j] != 0){ //we found someone we can wake up
-      struct thread *t = sem->threasd_array[j];
-      acquire(&myproc()->lock);
-      t->state = T_RUNNABLE;
-      release(&myproc()->lock);
-      sem->threasd_array[j] = 0;
+  // pass it on to the longest waiter that is still asleep. one that
+  // is killed is on its way out and would never give it back.
+  while((t = sem->waiters.head) != 0){
+    waitq_remove(&sem->waiters, t);
+    p = t->my_p;
+    acquire(&p->lock);
+    if(t->state == T_SLEEPING && !t->killed && !p->killed){
+      sem->owner = t;
+      handoff = sem->handoff;
+      if(handoff == BSEM_WAKE)
+        setrunnable(t);
+      else // let it run next on this CPU rather than wait its turn
+        setrunnable_next(t);
+      release(&p->lock);
+      break;
+    }
+    if(t->state == T_SLEEPING) // killed, but not woken yet
+      setrunnable(t);
+    release(&p->lock);
+  }
+  if(t == 0){ //no one is waiting
+    sem->owner = 0;
+    sem->free = 1;
+  }
+  release(&sem->lock);
+  if(handoff == BSEM_HANDOFF_YIELD)
+    yield();
+}
+
+// Set how bsem_up() wakes the waiter it hands the semaphore to.
+int bsem_sethandoff(int descriptor, int mode){
+  struct Bsemaphore *sem;
+  if(descriptor < 0 || descriptor >= MAX_BSEM ||
+     mode < BSEM_WAKE || mode > BSEM_HANDOFF_YIELD)
+    return -1;
+  sem = &binary_semaphores[descriptor];
+  acquire(&binary_semaphores_lock);
+  if(sem->descriptor != descriptor){
+    release(&binary_semaphores_lock);
+    return -1;
+  }
+  release(&binary_semaphores_lock);
+  acquire(&sem->lock);
+  sem->handoff = mode;
+  release(&sem->lock);
+  return 0;
+}
+
+// Copy the semaphore's spin/sleep counters to st.
+int bsem_stat(int descriptor, struct bsemstat *st){
+  struct Bsemaphore *sem;
+  if(descriptor < 0 || descriptor >= MAX_BSEM)
+    return -1;
+  sem = &binary_semaphores[descriptor];
+  acquire(&binary_semaphores_lock);
+  if(sem->descriptor != descriptor){
+    release(&binary_semaphores_lock);
+    return -1;
+  }
+  release(&binary_semaphores_lock);
+  acquire(&sem->lock);
+  st->spins = sem->spins;
+  st->sleeps = sem->sleeps;
+  release(&sem->lock);
+  return 0;
+}
+
+// Counting semaphores, kept in the kernel so that csem_down() and
+// csem_up() cost one system call each. Waiters are served in FIFO
+// order: ksem_up() hands units straight to the oldest waiter, and a
+// new ksem_down() never takes units while older threads still wait,
+// so a big ksem_down(n) can't be starved by a stream of small ones.
+
+// Allocates a counting semaphore with the given initial value and
+// returns its descriptor, or -1 if none is free.
+int ksem_alloc(int value){
+  int descriptor = -1;
+  int i=0;
+  if(value < 0)
+    return -1;
+  acquire(&counting_semaphores_lock);
+  for (i=0; i< MAX_CSEM; i++){
+    if (counting_semaphores[i].descriptor == -1){
+      counting_semaphores[i].descriptor=i;
+      descriptor =i;
+      break;
+    }
+  }
+  release(&counting_semaphores_lock);
+  if (descriptor != -1){
+    counting_semaphores[descriptor].value=value;
+    counting_semaphores[descriptor].waiters.head = 0;
+    counting_semaphores[descriptor].waiters.tail = 0;
+    initlock(&counting_semaphores[descriptor].lock, "counting_semaphores_array_lock");
+  }
+  return descriptor;
+}
+
+static struct Csemaphore*
+ksem_get(int descriptor){
+  if(descriptor < 0 || descriptor >= MAX_CSEM ||
+     counting_semaphores[descriptor].descriptor != descriptor)
+    return 0;
+  return &counting_semaphores[descriptor];
+}
+
+// Freeing a semaphore that threads are blocked on is undefined,
+// as with binary semaphores.
+int ksem_free(int descriptor){
+  if(ksem_get(descriptor) == 0)
+    return -1;
+  acquire(&counting_semaphores_lock);
+  counting_semaphores[descriptor].descriptor = -1;
+  release(&counting_semaphores_lock);
+  return 0;
+}
+
+// Hand units to waiters, oldest first, for as long as the oldest
+// live one's request can be met. Killed waiters are passed over.
+// sem->lock must be held.
+static void
+ksem_grant(struct Csemaphore *sem){
+  struct thread *t, *next;
+  struct proc *p;
+  for(t = sem->waiters.head; t != 0; t = next){
+    next = t->wqnext;
+    p = t->my_p;
+    acquire(&p->lock);
+    if(t->state != T_SLEEPING || t->killed || p->killed){
+      // a kill woke it, or will: it leaves the queue by itself
+      // and returns -1, so it gets no units.
+      if(t->state == T_SLEEPING)
+        setrunnable(t);
+      release(&p->lock);
+      continue;
+    }
+    if(sem->value < t->semwant){
+      release(&p->lock);
+      break;
+    }
+    sem->value -= t->semwant;
+    waitq_remove(&sem->waiters, t);
+    setrunnable(t);
+    release(&p->lock);
+  }
+}
+
+// Takes n units, blocking until they are available.
+// Returns -1 without taking any if the caller is killed.
+int ksem_down(int descriptor, int n){
+  struct proc *p = myproc();
+  struct thread *t = mythread();
+  struct Csemaphore *sem;
+  if((sem = ksem_get(descriptor)) == 0 || n <= 0)
+    return -1;
+  acquire(&sem->lock);
+  if(sem->waiters.head == 0 && sem->value >= n){
+    sem->value -= n;
+    release(&sem->lock);
+    return 0;
+  }
+  if(p->killed || t->killed){
+    release(&sem->lock);
+    return -1;
+  }
+
+  acquire(&p->lock);
+  t->semwant = n;
+  waitq_push(&sem->waiters, t);
+  t->state = T_SLEEPING;
+  release(&sem->lock);
+  sched();
+  release(&p->lock);
+
+  // ksem_grant() took us off the queue along with our units,
+  // unless something else (a kill) woke us first. Leaving may
+  // let the waiters behind us through.
+  if(t->wq){
+    acquire(&sem->lock);
+    if(t->wq){
+      waitq_remove(t->wq, t);
+      ksem_grant(sem);
       release(&sem->lock);
-      return;
+      return -1;
     }
+    release(&sem->lock);
   }
-  //no one is waiting
-  sem->free = 1; 
+  return 0;
+}
+
+// Returns n units and wakes the waiters they satisfy.
+int ksem_up(int descriptor, int n){
+  struct Csemaphore *sem;
+  if((sem = ksem_get(descriptor)) == 0 || n <= 0)
+    return -1;
+  acquire(&sem->lock);
+  sem->value += n;
+  ksem_grant(sem);
   release(&sem->lock);
+  return 0;
 }
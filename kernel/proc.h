@@ -24,6 +24,19 @@ struct sigaction {
   uint sigmask;
 };
 
+// what sigtimedwait() reports about the signal it took.
+struct siginfo {
+  int si_signo;
+  int si_value;     // sigqueue()'s payload; 0 for kill()
+  int si_pid;       // sender, for sigqueue()
+};
+
+// an instance of a signal queued by sigqueue(), on p->sigq.
+struct sigqueued {
+  struct sigqueued *next;
+  struct siginfo info;
+};
+
 // Per-CPU state.
 struct cpu {
   struct proc *proc;          // The process' thread running on this cpu, or null.
@@ -31,12 +44,24 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+
+  // rqlock must be held when using these:
+  struct spinlock rqlock;     // protects this CPU's run queue
+  struct thread *rqhead[NPRIO]; // runnable threads per level, oldest first
+  struct thread *rqtail[NPRIO];
+  volatile int rqlen;         // read without rqlock by idle harts looking for work
+  volatile uint rqmask;       // bit i set if level i is non-empty; read without rqlock
+  uint rqepoch;               // boost epoch the queue was last boosted in
+
+  // for tlb_shootdown(); written by this CPU only, read by others:
+  pagetable_t volatile upt;   // user page table while in user mode, else 0
+  volatile uint64 utraps;     // traps taken from user mode
 };
 
 extern struct cpu cpus[NCPU];
 
 // per-process data for the trap handling code in trampoline.S.
-// sits in a page by itself just under the trampoline page in the
+// sits in a page by itself under the trampoline pages in the
 // user page table. not specially mapped in the kernel page table.
 // the sscratch register points here.
 // uservec in trampoline.S saves user registers in the trapframe,
@@ -87,10 +112,25 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// FIFO of threads, linked through t->wqnext and t->wqprev.
+// Used for sleep queues and semaphore waiters; the queue's
+// owner provides the lock. A thread is on at most one.
+struct waitq {
+  struct thread *head;
+  struct thread *tail;
+};
+
 enum procstate { UNUSED, USED, RUNNABLE, ZOMBIE };
 enum threadstate { T_UNUSED, T_USED, T_SLEEPING, T_RUNNABLE, T_RUNNING, T_ZOMBIE };
 
 
+// Trapframes are packed TFPERPAGE to a page, and the pages are
+// mapped from TRAPFRAME down. Thread slot i's trapframe is at
+// user address TRAPFRAMEVA(i).
+#define TFPERPAGE (PGSIZE / sizeof(struct trapframe))
+#define TRAPFRAMEVA(i) (TRAPFRAME - ((i) / TFPERPAGE) * PGSIZE + \
+                        ((i) % TFPERPAGE) * sizeof(struct trapframe))
+
 // Per-thread state
 struct thread {
 
@@ -102,6 +142,26 @@ struct thread {
   int tid;                     // thread ID
   struct proc *my_p;           // the process I belong to 
 
+  // c->rqlock of the owning run queue must be held when using these:
+  struct cpu *rqcpu;           // run queue this thread sits on, or 0
+  struct thread *rqnext;       // next thread on that run queue
+
+  // p->lock must be held when using these:
+  int prio;                    // scheduler level it runs and queues at; 0 is highest
+  int baseprio;                // level set by setpriority(); boosts return it here
+  int prioticks;               // ticks run at prio, toward the level's allotment
+  int slice;                   // ticks run since it was last scheduled
+  uint prioepoch;              // boost epoch prio was last reset in
+
+  // the lock protecting t->wq must be held when using these:
+  struct waitq *wq;            // wait queue this thread sleeps on, or 0
+  struct thread *wqnext;
+  struct thread *wqprev;
+  int semwant;                 // units wanted while blocked in ksem_down()
+  int slot;                    // index in my_p->threads
+  int ustack;                  // kernel-managed stack region, or -1
+  int detached;                // nobody will join it; reuse once a zombie
+
   // proc_tree_lock must be held when using this:
 
   // these are private to the process, so p->lock need not be held.
@@ -112,6 +172,10 @@ struct thread {
 
   //fields for signals - our code
   struct trapframe* user_trap_frame_backup;
+  uint pending_signals;        // sent to this thread by tkill() or routed to it by kill()
+  uint signal_mask;            // signals this thread blocks
+  uint signal_mask_backup;     // its mask while outside a handler
+  int handling_signal_counter; // counts how many handlers it is in
 
  };
 
@@ -128,6 +192,11 @@ struct proc {
 
   // proc_tree_lock must be held when using this:
   struct proc *parent;         // Parent process
+  struct proc *children;       // first child, under wait_lock
+  struct proc *sibling;        // next child of parent, under wait_lock
+  struct proc *hashnext;       // next in its pidhash chain, under pid_lock
+  struct proc *allnext;        // next on allprocs; never changes once set
+  struct proc *freenext;       // next on freeprocs, under proclist_lock
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
@@ -136,13 +205,17 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
-  struct thread threads[NTHREAD]; //the arrrrrray for all the threads oof the process
+  struct thread *threads[MAXTHREAD]; // thread slots; threads[0] always exists
+  int nthreads;                // slots with a struct thread, from the start
+  int maxthreads;              // limit on threads that are not T_UNUSED or T_ZOMBIE
+  char *tfpages[NTRAPFRAMEPAGES]; // trapframe region pages, from TRAPFRAME down
+  int ntfpages;                // how many of those are allocated
 
   //fields for signals - our code
-  uint pending_signals;
-  uint signal_mask;
-  uint signal_mask_backup; 
-  int handling_signal_counter;     // counts how many signals we are handling
+  uint pending_signals;            // sent to p while every thread blocked them
+  struct sigqueued *sigq;          // sigqueue()'d instances, oldest first
+  int nsigq;
+  int sigwaiters;                  // threads in sigtimedwait()
   
   void* signal_handlers[32];        // array of the handlings - can be an address of a function from the user OR a number (SIG_IGN for example) 
   int signal_handlers_maskes[32];   // array of the maskes - per signal and its cause is the signal handler
@@ -151,13 +224,48 @@ struct proc {
   struct trapframe *trapframe; // data page for trampoline.S
   int handling_signals;
 
+  // threads waiting in kthread_join*() sleep on joinlock, and
+  // an exiting thread holds it while it wakes them and becomes a
+  // zombie. taken before p->lock.
+  struct spinlock joinlock;
+  int exiting;                 // a thread is tearing down the others, under joinlock
+
+  // threads of a stopped process sleep on &p->stopped holding
+  // stoplock, and whoever continues or kills p holds it while it
+  // wakes them. taken before p->lock.
+  struct spinlock stoplock;
+
+  // vmlock must be held when mapping lazily reserved pages or
+  // changing sz; it nests inside every other lock but kmem's.
+  struct spinlock vmlock;
+  uint64 lazyreserved;         // heap pages sbrk() reserved without mapping
+  uint64 lazyfaulted;          // how many of those have been touched
+
+  // kernel-managed thread stacks; p->lock and vmlock must both be
+  // held to change these, either one to read them.
+  uint64 stackmap;             // stack regions in use, a bit each
+  int nstacks;                 // regions that may have pages mapped
+  uint stacksize[MAXTHREAD];   // each region's stack size, kept after use
+
 };
 
  
 //Binary Semaphore
 struct Bsemaphore {
   int descriptor;
-  int free;
-  struct thread *threasd_array[NPROC * NTHREAD]; //if null - the thread with this index is not waiting for the resource' otherwise it is waiting and we havee its address.
+  volatile int free;           // read without lock by spinners
+  struct thread *volatile owner; // last thread to take it, or 0 when free
+  struct waitq waiters;        // threads blocked in bsem_down(), oldest first
   struct spinlock lock;
-};
\ No newline at end of file
+  int handoff;                 // BSEM_WAKE or a BSEM_HANDOFF_* mode (bsem.h)
+  uint64 spins;                // acquisitions after spinning
+  uint64 sleeps;               // acquisitions that slept
+};
+
+//Counting Semaphore
+struct Csemaphore {
+  int descriptor;
+  int value;
+  struct waitq waiters;        // threads blocked in ksem_down(), oldest first
+  struct spinlock lock;
+};
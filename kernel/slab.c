@@ -0,0 +1,217 @@
+// Slab allocator for small fixed-size kernel objects, such as
+// trapframe backups and pipes, that would otherwise each take a
+// whole page from kalloc().
+//
+// Each cache carves pages into objects of one size. A page
+// ("slab") starts with a struct slab header that keeps the page's
+// free objects on a list. Allocations and frees go through a
+// per-CPU magazine first, and only move objects to or from slabs,
+// under the cache lock, in batches of MAGSIZE/2.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "slab.h"
+#include "sysinfo.h"
+#include "defs.h"
+
+#define NSLABCACHE 16
+
+struct slab {
+  struct slab *next;      // on the cache's partial list
+  struct slabcache *c;
+  void **free;            // free objects; the first word links them
+  int inuse;              // objects out of this slab, magazines included
+};
+
+#define SLABHDR ((sizeof(struct slab) + 7) & ~7)
+#define OBJ2SLAB(o) ((struct slab*)PGROUNDDOWN((uint64)(o)))
+
+static struct spinlock slabcaches_lock;
+static struct slabcache *slabcaches[NSLABCACHE];
+static int nslabcaches;
+
+// Set up cache c for objects of the given size.
+void
+slabinit(struct slabcache *c, char *name, uint size)
+{
+  memset(c, 0, sizeof(*c));
+  c->name = name;
+  c->size = (size + 7) & ~7;
+  if(c->size < sizeof(void*))
+    c->size = sizeof(void*);
+  c->perslab = (PGSIZE - SLABHDR) / c->size;
+  if(c->perslab == 0)
+    panic("slabinit: too big");
+  initlock(&c->lock, "slab");
+
+  if(nslabcaches == 0)
+    initlock(&slabcaches_lock, "slabcaches");
+  acquire(&slabcaches_lock);
+  if(nslabcaches == NSLABCACHE)
+    panic("slabinit: too many caches");
+  slabcaches[nslabcaches++] = c;
+  release(&slabcaches_lock);
+}
+
+// Get a fresh slab page from kalloc().
+// Caller holds c->lock.
+static struct slab*
+slabgrow(struct slabcache *c)
+{
+  struct slab *s;
+  char *o;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->c = c;
+  s->inuse = 0;
+  s->free = 0;
+  for(o = (char*)s + SLABHDR + (c->perslab - 1) * c->size;
+      o >= (char*)s + SLABHDR; o -= c->size){
+    *(void**)o = s->free;
+    s->free = (void**)o;
+  }
+  s->next = c->partial;
+  c->partial = s;
+  c->nslabs++;
+  c->nempty++;
+  return s;
+}
+
+// Move up to n objects from the cache's slabs into magazine m.
+static void
+slabrefill(struct slabcache *c, struct magazine *m, int n)
+{
+  struct slab *s;
+
+  acquire(&c->lock);
+  while(n-- > 0){
+    if((s = c->partial) == 0 && (s = slabgrow(c)) == 0)
+      break;
+    if(s->inuse++ == 0)
+      c->nempty--;
+    m->obj[m->n++] = s->free;
+    s->free = *s->free;
+    if(s->free == 0)  // now full; it goes back on partial when freed into
+      c->partial = s->next;
+  }
+  release(&c->lock);
+}
+
+// Give the n oldest objects in magazine m back to their slabs,
+// and return a slab's page to kalloc() if it ends up unused while
+// the cache already has an empty slab in reserve.
+static void
+slabflush(struct slabcache *c, struct magazine *m, int n)
+{
+  struct slab *s, **pp;
+  void **o;
+  int i;
+
+  acquire(&c->lock);
+  for(i = 0; i < n; i++){
+    o = m->obj[i];
+    s = OBJ2SLAB(o);
+    if(s->c != c)
+      panic("slabfree: wrong cache");
+    if(s->free == 0){
+      s->next = c->partial;
+      c->partial = s;
+    }
+    *o = s->free;
+    s->free = o;
+    if(--s->inuse > 0)
+      continue;
+    if(c->nempty == 0){
+      c->nempty++;
+      continue;
+    }
+    for(pp = &c->partial; *pp != s; pp = &(*pp)->next)
+      ;
+    *pp = s->next;
+    c->nslabs--;
+    kfree(s);
+  }
+  release(&c->lock);
+
+  m->n -= n;
+  memmove(m->obj, m->obj + n, m->n * sizeof(m->obj[0]));
+}
+
+// Allocate an object from cache c.
+// Returns 0 if no memory is left.
+void*
+slaballoc(struct slabcache *c)
+{
+  struct magazine *m;
+  void *o;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n > 0)
+    m->hits++;
+  else
+    slabrefill(c, m, MAGSIZE/2);
+  o = 0;
+  if(m->n > 0){
+    o = m->obj[--m->n];
+    m->allocs++;
+  }
+  pop_off();
+  if(o)
+    memset(o, 5, c->size); // fill with junk
+  return o;
+}
+
+// Return object o to cache c.
+void
+slabfree(struct slabcache *c, void *o)
+{
+  struct magazine *m;
+
+  memset(o, 1, c->size);  // fill with junk to catch dangling refs
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE)
+    slabflush(c, m, MAGSIZE/2);
+  m->obj[m->n++] = o;
+  m->frees++;
+  pop_off();
+}
+
+// Copy out the counters of the i'th cache.
+// Returns -1 if there is no such cache.
+int
+slab_stat(int i, struct slabstat *st)
+{
+  struct slabcache *c;
+  struct magazine *m;
+
+  acquire(&slabcaches_lock);
+  c = i >= 0 && i < nslabcaches ? slabcaches[i] : 0;
+  release(&slabcaches_lock);
+  if(c == 0)
+    return -1;
+
+  memset(st, 0, sizeof(*st));
+  safestrcpy(st->name, c->name, sizeof(st->name));
+  st->objsize = c->size;
+  st->perslab = c->perslab;
+  acquire(&c->lock);
+  st->slabs = c->nslabs;
+  release(&c->lock);
+  // the magazines are read without their CPUs' cooperation,
+  // so these can be slightly stale.
+  for(m = c->mag; m < &c->mag[NCPU]; m++){
+    st->allocs += m->allocs;
+    st->frees += m->frees;
+    st->hits += m->hits;
+    st->cached += m->n;
+  }
+  st->inuse = st->allocs - st->frees;
+  return 0;
+}
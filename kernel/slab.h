@@ -0,0 +1,27 @@
+// Object caches for small fixed-size kernel objects.
+// Needs param.h and spinlock.h.
+
+#define MAGSIZE 16  // objects a CPU's magazine can hold
+
+// A CPU's private stack of free objects. Only that CPU touches it,
+// with interrupts off, so it needs no lock.
+struct magazine {
+  int n;                  // objects in obj[]
+  void *obj[MAGSIZE];
+  uint64 allocs;          // slaballoc() calls on this CPU
+  uint64 frees;           // slabfree() calls on this CPU
+  uint64 hits;            // allocs served without taking the cache lock
+};
+
+struct slabcache {
+  char *name;
+  uint size;              // object size, rounded up to 8 bytes
+  uint perslab;           // objects per slab page
+
+  struct spinlock lock;   // protects the fields below
+  struct slab *partial;   // slabs with at least one free object
+  int nslabs;             // pages held, full or not
+  int nempty;             // slabs on partial with no objects in use
+
+  struct magazine mag[NCPU];
+};
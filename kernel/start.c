@@ -38,6 +38,11 @@ start()
   w_mideleg(0xffff);
   w_sie(r_sie() | SIE_SEIE | SIE_STIE | SIE_SSIE);
 
+  // let supervisor and user mode read the time CSR,
+  // for r_time() and the user library's rdtime().
+  w_mcounteren(r_mcounteren() | 2);
+  w_scounteren(r_scounteren() | 2);
+
   // ask for clock interrupts.
   timerinit();
 
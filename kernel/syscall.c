@@ -115,6 +115,24 @@ extern uint64 sys_bsem_alloc(void);
 extern uint64 sys_bsem_free(void);
 extern uint64 sys_bsem_down(void);
 extern uint64 sys_bsem_up(void);
+extern uint64 sys_sysinfo(void);
+extern uint64 sys_futex(void);
+extern uint64 sys_ksem_alloc(void);
+extern uint64 sys_ksem_free(void);
+extern uint64 sys_ksem_down(void);
+extern uint64 sys_ksem_up(void);
+extern uint64 sys_bsem_stat(void);
+extern uint64 sys_bsem_sethandoff(void);
+extern uint64 sys_slabstat(void);
+extern uint64 sys_kthread_limit(void);
+extern uint64 sys_kthread_run(void);
+extern uint64 sys_kthread_detach(void);
+extern uint64 sys_kthread_join_any(void);
+extern uint64 sys_tkill(void);
+extern uint64 sys_sigqueue(void);
+extern uint64 sys_sigtimedwait(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_getpriority(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -149,6 +167,24 @@ static uint64 (*syscalls[])(void) = {
 [SYS_bsem_free]          sys_bsem_free,
 [SYS_bsem_down]          sys_bsem_down,
 [SYS_bsem_up]            sys_bsem_up,
+[SYS_sysinfo]            sys_sysinfo,
+[SYS_futex]              sys_futex,
+[SYS_ksem_alloc]         sys_ksem_alloc,
+[SYS_ksem_free]          sys_ksem_free,
+[SYS_ksem_down]          sys_ksem_down,
+[SYS_ksem_up]            sys_ksem_up,
+[SYS_bsem_stat]          sys_bsem_stat,
+[SYS_bsem_sethandoff]    sys_bsem_sethandoff,
+[SYS_slabstat]           sys_slabstat,
+[SYS_kthread_limit]      sys_kthread_limit,
+[SYS_kthread_run]        sys_kthread_run,
+[SYS_kthread_detach]     sys_kthread_detach,
+[SYS_kthread_join_any]   sys_kthread_join_any,
+[SYS_tkill]              sys_tkill,
+[SYS_sigqueue]           sys_sigqueue,
+[SYS_sigtimedwait]       sys_sigtimedwait,
+[SYS_setpriority]        sys_setpriority,
+[SYS_getpriority]        sys_getpriority,
 };
 
 void
@@ -31,3 +31,21 @@
 #define SYS_bsem_free           30
 #define SYS_bsem_down           31
 #define SYS_bsem_up             32
+#define SYS_sysinfo             33
+#define SYS_futex               34
+#define SYS_ksem_alloc          35
+#define SYS_ksem_free           36
+#define SYS_ksem_down           37
+#define SYS_ksem_up             38
+#define SYS_bsem_stat           39
+#define SYS_bsem_sethandoff     40
+#define SYS_slabstat            41
+#define SYS_kthread_limit       42
+#define SYS_kthread_run         43
+#define SYS_kthread_detach      44
+#define SYS_kthread_join_any    45
+#define SYS_tkill               46
+#define SYS_sigqueue            47
+#define SYS_sigtimedwait        48
+#define SYS_setpriority         49
+#define SYS_getpriority         50
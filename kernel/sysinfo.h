@@ -0,0 +1,29 @@
+// Kernel statistics, copied out by the sysinfo() system call.
+struct sysinfo {
+  uint64 ticks;        // clock interrupts so far
+  uint64 tickcycles;   // rdtime cycles spent handling them in clockintr()
+  uint64 freepages;    // physical pages on the kalloc() free list
+  uint64 lazyreserved; // heap pages the caller's sbrk() calls reserved
+  uint64 lazyfaulted;  // how many of those it has touched
+};
+
+// Per-semaphore counters, copied out by bsem_stat().
+struct bsemstat {
+  uint64 spins;        // bsem_down() calls that got it by spinning
+  uint64 sleeps;       // bsem_down() calls that had to sleep
+};
+
+// Per-cache slab allocator counters, copied out by slabstat().
+// A cache holding inuse objects in slabs pages saves
+// inuse - slabs pages over giving each object its own page.
+struct slabstat {
+  char name[16];
+  uint64 objsize;      // bytes per object
+  uint64 perslab;      // objects per page
+  uint64 slabs;        // pages the cache holds
+  uint64 inuse;        // objects allocated right now
+  uint64 cached;       // free objects sitting in per-CPU magazines
+  uint64 allocs;       // slaballoc() calls so far
+  uint64 frees;        // slabfree() calls so far
+  uint64 hits;         // allocs served from a magazine without locking
+};
@@ -6,6 +6,9 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "sysinfo.h"
+#include "futex.h"
+#include "kthread.h"
 
 uint64 //our code
 sys_bsem_alloc(void) 
@@ -50,6 +53,94 @@ sys_bsem_up(void)
   return 0;
 }
 
+uint64 //our code
+sys_bsem_stat(void)
+{
+  int descriptor;
+  uint64 addr;
+  struct bsemstat st;
+  if(argint(0, &descriptor) < 0 || argaddr(1, &addr) < 0){
+    return -1;
+  }
+  if(bsem_stat(descriptor, &st) < 0){
+    return -1;
+  }
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0){
+    return -1;
+  }
+  return 0;
+}
+
+uint64 //our code
+sys_bsem_sethandoff(void)
+{
+  int descriptor, mode;
+  if(argint(0, &descriptor) < 0 || argint(1, &mode) < 0){
+    return -1;
+  }
+  return bsem_sethandoff(descriptor, mode);
+}
+
+// copy the counters of the i'th slab cache out to a user
+// struct slabstat. returns -1 past the last cache.
+uint64
+sys_slabstat(void)
+{
+  int i;
+  uint64 addr;
+  struct slabstat st;
+  if(argint(0, &i) < 0 || argaddr(1, &addr) < 0){
+    return -1;
+  }
+  if(slab_stat(i, &st) < 0){
+    return -1;
+  }
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0){
+    return -1;
+  }
+  return 0;
+}
+
+uint64 //our code
+sys_ksem_alloc(void)
+{
+  int value;
+  if(argint(0, &value) < 0){
+    return -1;
+  }
+  return ksem_alloc(value);
+}
+
+uint64 //our code
+sys_ksem_free(void)
+{
+  int descriptor;
+  if(argint(0, &descriptor) < 0){
+    return -1;
+  }
+  return ksem_free(descriptor);
+}
+
+uint64 //our code
+sys_ksem_down(void)
+{
+  int descriptor, n;
+  if(argint(0, &descriptor) < 0 || argint(1, &n) < 0){
+    return -1;
+  }
+  return ksem_down(descriptor, n);
+}
+
+uint64 //our code
+sys_ksem_up(void)
+{
+  int descriptor, n;
+  if(argint(0, &descriptor) < 0 || argint(1, &n) < 0){
+    return -1;
+  }
+  return ksem_up(descriptor, n);
+}
+
 
 
 uint64 //our code
@@ -58,14 +149,18 @@ sys_kthread_create(void)
   //first moving user argument to the kernel
   uint64 start_func;
   uint64 stack;
+  uint64 tls;
   if(argaddr(0, &start_func) < 0){ 
     return -1;
   }
   if(argaddr(1, &stack) < 0){ 
     return -1; 
   }
+  if(argaddr(2, &tls) < 0){ 
+    return -1; 
+  }
   //second - calling function
-  return kthread_create( (void *)start_func, (void *)stack);
+  return kthread_create( (void *)start_func, (void *)stack, (void *)tls);
 }
 
 uint64 //our code
@@ -105,6 +200,79 @@ sys_kthread_join(void)
   return kthread_join(thread_id, (int*)status);
 }
 
+uint64 //our code
+sys_kthread_detach(void)
+{
+  int thread_id;
+
+  if(argint(0, &thread_id) < 0){
+    return -1;
+  }
+  return kthread_detach(thread_id);
+}
+
+uint64 //our code
+sys_kthread_join_any(void)
+{
+  uint64 status;
+
+  if(argaddr(0, &status) < 0){
+    return -1;
+  }
+  return kthread_join_any((int*)status);
+}
+
+uint64 //our code
+sys_kthread_limit(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0){
+    return -1;
+  }
+  return kthread_limit(n);
+}
+
+uint64 //our code
+sys_setpriority(void)
+{
+  int tid;
+  int prio;
+
+  if(argint(0, &tid) < 0)
+    return -1;
+  if(argint(1, &prio) < 0)
+    return -1;
+  return setpriority(tid, prio);
+}
+
+uint64 //our code
+sys_getpriority(void)
+{
+  int tid;
+
+  if(argint(0, &tid) < 0)
+    return -1;
+  return getpriority(tid);
+}
+
+uint64 //our code
+sys_kthread_run(void)
+{
+  uint64 entry, fn, arg, addr;
+  struct kthread_attr attr;
+
+  if(argaddr(0, &entry) < 0 || argaddr(1, &fn) < 0 ||
+     argaddr(2, &arg) < 0 || argaddr(3, &addr) < 0){
+    return -1;
+  }
+  memset(&attr, 0, sizeof(attr));
+  if(addr && copyin(myproc()->pagetable, (char *)&attr, addr, sizeof(attr)) < 0){
+    return -1;
+  }
+  return kthread_run(entry, fn, arg, &attr);
+}
+
 
 uint64 //our code
 sys_sigprocmask(void) 
@@ -202,7 +370,8 @@ sys_sleep(void)
   acquire(&tickslock);
   ticks0 = ticks;
   while(ticks - ticks0 < n){
-    if(myproc()->killed){
+    // a signal for this thread ends the sleep, so its handler runs.
+    if(myproc()->killed || signal_pending()){
       release(&tickslock);
       return -1;
     }
@@ -225,6 +394,72 @@ sys_kill(void)
   return kill(pid, signum);  //new kill
 }
 
+uint64 //our code
+sys_tkill(void)
+{
+  int tid;
+  int signum;
+
+  if(argint(0, &tid) < 0)
+    return -1;
+  if(argint(1, &signum) < 0)
+    return -1;
+  return tkill(tid, signum);
+}
+
+uint64 //our code
+sys_sigqueue(void)
+{
+  int pid;
+  int signum;
+  int value;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  if(argint(1, &signum) < 0)
+    return -1;
+  if(argint(2, &value) < 0)
+    return -1;
+  return sigqueue(pid, signum, value);
+}
+
+uint64 //our code
+sys_sigtimedwait(void)
+{
+  int set;
+  uint64 info;
+  int timeout;
+
+  if(argint(0, &set) < 0)
+    return -1;
+  if(argaddr(1, &info) < 0)
+    return -1;
+  if(argint(2, &timeout) < 0)
+    return -1;
+  return sigtimedwait((uint)set, info, timeout);
+}
+
+// copy kernel statistics out to a user struct sysinfo.
+uint64
+sys_sysinfo(void)
+{
+  uint64 addr;
+  struct sysinfo info;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  acquire(&tickslock);
+  info.ticks = ticks;
+  info.tickcycles = tickcycles;
+  release(&tickslock);
+  info.freepages = kfreepages();
+  info.lazyreserved = myproc()->lazyreserved;
+  info.lazyfaulted = myproc()->lazyfaulted;
+  if(copyout(myproc()->pagetable, addr, (char *)&info, sizeof(info)) < 0)
+    return -1;
+  return 0;
+}
+
 // return how many clock tick interrupts have occurred
 // since start.
 uint64
@@ -237,3 +472,21 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// wait on or wake a user word; see kernel/futex.h.
+uint64
+sys_futex(void)
+{
+  uint64 addr;
+  int op, val;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &op) < 0 || argint(2, &val) < 0)
+    return -1;
+  switch(op){
+  case FUTEX_WAIT:
+    return futex_wait(addr, val);
+  case FUTEX_WAKE:
+    return futex_wake(addr, val);
+  }
+  return -1;
+}
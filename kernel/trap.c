@@ -8,6 +8,7 @@
 
 struct spinlock tickslock;
 uint ticks;
+uint64 tickcycles;  // rdtime cycles spent in clockintr(), for sysinfo()
 
 extern char trampoline[], uservec[], userret[];
 
@@ -47,6 +48,11 @@ usertrap(void)
 
   struct proc *p = myproc();
   struct thread *t = mythread();
+  struct cpu *c = mycpu();
+
+  // uservec flushed this CPU's user TLB entries; see tlb_shootdown().
+  c->upt = 0;
+  c->utraps++;
   
   // save user program counter.
   t->trapframe->epc = r_sepc();
@@ -73,6 +79,18 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if(r_scause() == 15 && uvmcow(p->pagetable, r_stval()) == 0){
+    // store to a copy-on-write page; it's ours now.
+  } else if((r_scause() == 13 || r_scause() == 15) &&
+            lazyfault(p->pagetable, r_stval(), r_scause() == 15) == 0){
+    // first touch of memory that sbrk() reserved, or of a stack.
+  } else if((r_scause() == 13 || r_scause() == 15) &&
+            r_stval() >= TSTACKS && r_stval() < TSTACKTOP(MAXTHREAD-1)){
+    // ran off the end of a kernel-managed stack (or into an unused
+    // region): only this thread dies.
+    printf("usertrap(): stack overflow pid=%d tid=%d sepc=%p stval=%p\n",
+           p->pid, t->tid, r_sepc(), r_stval());
+    t->killed = 1;
   } else {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
@@ -89,9 +107,10 @@ usertrap(void)
   }
 
 
-  // give up the CPU if this is a timer interrupt.
+  // give up the CPU if this is a timer interrupt
+  // and the thread's time slice is over.
   if(which_dev == 2)
-    yield();
+    preempt();
   
   usertrapret();
 }
@@ -140,42 +159,72 @@ usertrapret(void)
 
   // tell trampoline.S the user page table to switch to.
   uint64 satp = MAKE_SATP(p->pagetable);
+
+  // from here on this CPU may cache p's user mappings.
+  mycpu()->upt = p->pagetable;
+  __sync_synchronize();
   //printf("about to move to user space, tid: %d\n", t->tid);
   // jump to trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 fn = TRAMPOLINE + (userret - trampoline);
 
-  //((void (*)(uint64,uint64))fn)(TRAPFRAME + ((t-p->threads) * sizeof(struct trapframe)), satp);
-  ((void (*)(uint64,uint64))fn)(TRAPFRAME + (t->trapframe - p->threads[0].trapframe) *sizeof(struct trapframe), satp);
-  //((void (*)(uint64,uint64))fn)(TRAPFRAME , satp);
+  ((void (*)(uint64,uint64))fn)(TRAPFRAMEVA(t->slot), satp);
 }
 
 //
 // our code - searchong and handling stop and cont
-// prioritized over other signals
+// prioritized over other signals. while p is stopped we sleep on
+// p->stopped, off every run queue, until SIGCONT or a kill.
+// p->lock must be held; it is released while we sleep.
 void
 handling_stop_cont(struct proc *p){
-  while(p->stopped){
-
-    if(p->killed){
-      printf("found out i am killed\n");
-      p->stopped =0;
-      return;
-    }
+  struct thread *t = mythread();
 
+  while(p->stopped && !p->killed && !t->killed){
     release(&p->lock);
-    yield();
+    acquire(&p->stoplock);
+    // kill() holds stoplock to wake us after it clears p->stopped
+    // or sets p->killed, so looking again under it can't miss that.
+    if(p->stopped && !p->killed && !t->killed)
+      sleep(&p->stopped, &p->stoplock);
+    release(&p->stoplock);
     acquire(&p->lock);
   }
 }
 
+// index of the lowest set bit of x, which must not be 0.
+// rv64gc has no count-trailing-zeros instruction (that is Zbb),
+// so isolate the bit and look it up with a de Bruijn sequence.
+int
+lowbit(uint x)
+{
+  static const char pos[32] = {
+    0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+    31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
+  };
+
+  return pos[((x & -x) * 0x077CB531U) >> 27];
+}
+
 //
 // our code - handling the current process signals
 //
 void
 signals_handling(struct proc *p)
 {
+  struct thread *t = mythread();
+  struct siginfo info;
+  uint todo;
+  int signum;
+
+  // this runs on every return to user space and there is almost
+  // never a signal, so look without p->lock first. a signal that
+  // comes after the look is taken on the next return, just as if
+  // it had come after a look under the lock.
+  if(!p->stopped &&
+     ((p->pending_signals | t->pending_signals) & ~t->signal_mask) == 0)
+    return;
 
   acquire(&p->lock);
 
@@ -183,63 +232,59 @@ signals_handling(struct proc *p)
   
   
   //printf("after handling stop cont \n");
-  for (int signum=0; signum<32; signum++){
-    if(p->pending_signals & (1<<signum)){
-      if(!(p->signal_mask & (1<<signum))){
-        if(p->signal_handlers[signum]== (void *)SIG_DFL){//if default we wanna commit kill
-          if(p->handling_signals ==0){
-            p->handling_signals = 1;
-            release(&p->lock);
-            exit(-1);
-          }
-          else{
-            release(&p->lock);
-            kthread_exit(-1);
-          }
-
-        }
-        else{ // user space handle!!! not stop, cont, kill, default or ignore (ignore was dealt with on sigaction)
-          p->handling_signal_counter++;
-          if (p->handling_signal_counter == 1){
-            p->signal_mask_backup = p->signal_mask;
-          }
-          p->signal_mask = p->signal_handlers_maskes[signum];
-          //maybe release?
-          user_signal_handlng(p, signum);
-          //maybe aquire?
-          p->handling_signal_counter--;
-          p->signal_mask = p->signal_mask_backup;
-        }
-        //turn off the bit of the signal we have just handled
-        p->pending_signals = p->pending_signals ^ (1<<signum); 
+  // only the pending signals we don't block, lowest first.
+  todo = (p->pending_signals | t->pending_signals) & ~t->signal_mask;
+  for(; todo != 0; todo &= todo - 1){
+    signum = lowbit(todo);
+    if(p->signal_handlers[signum]== (void *)SIG_DFL){//if default we wanna commit kill
+      if(p->handling_signals ==0){
+        p->handling_signals = 1;
+        release(&p->lock);
+        exit(-1);
+      }
+      else{
+        release(&p->lock);
+        kthread_exit(-1);
+      }
+
+    }
+    else{ // user space handle!!! not stop, cont, kill, default or ignore (ignore was dealt with on sigaction)
+      t->handling_signal_counter++;
+      if (t->handling_signal_counter == 1){
+        t->signal_mask_backup = t->signal_mask;
       }
-    } 
+      t->signal_mask = p->signal_handlers_maskes[signum];
+      // ours first, then one sent to p while every thread blocked it.
+      sig_take(p, t, signum, &info);
+      //maybe release?
+      user_signal_handlng(p, signum, info.si_value);
+      //maybe aquire?
+      t->handling_signal_counter--;
+      t->signal_mask = t->signal_mask_backup;
+      // one handler at a time: there is one trapframe backup, and
+      // the next pending signal is taken when sigret() returns.
+      break;
+    }
   }
   release(&p->lock);
 }
 
 void
-user_signal_handlng(struct proc *p, int signum){
+user_signal_handlng(struct proc *p, int signum, int value){
   struct thread *t = mythread();
   //first - backing up
   memmove( t->user_trap_frame_backup, t->trapframe, sizeof(struct trapframe));
 
-  //for li a7, SYS_sigret (ecall)
-  char array[] = {0x93 ,0x08 ,0x80 ,0x01 ,0x73 ,0x00 ,0x00 ,0x00};
-
-  //injecting the sigret ecall into the user stack 
-  copyout(p->pagetable, t->trapframe->sp, array, 8);
-
-  // updating the return address to the sigret
-  t->trapframe->ra = t->trapframe->sp;
+  // the handler returns to sigtramp.S, which calls sigret(). the
+  // handler's frame goes below the interrupted code's, on its stack.
+  t->trapframe->ra = SIGTRAMPOLINE;
 
   struct sigaction * func_address = p->signal_handlers[signum];
 
-  // Move SP down
-  t->trapframe->sp = t->trapframe->sp - 8;
-
-  // set the argument of the function
+  // set the arguments of the function: the signal, and the
+  // value sigqueue() sent with it, for a handler that wants it.
   t->trapframe->a0 = signum;
+  t->trapframe->a1 = value;
 
   // set the user place to go to (epc) to the function of handling got from the user.
   t->trapframe->epc = (uint64)(func_address);
@@ -266,11 +311,12 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
+  // give up the CPU if this is a timer interrupt
+  // and the thread's time slice is over.
   if(which_dev == 2 && mythread() != 0 && mythread()->state == T_RUNNING)
-    yield();
+    preempt();
 
-  // the yield() may have caused some traps to occur,
+  // the preempt() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
   w_sepc(sepc);
   w_sstatus(sstatus);
@@ -279,9 +325,12 @@ kerneltrap()
 void
 clockintr()
 {
+  uint64 start = r_time();
+
   acquire(&tickslock);
   ticks++;
   wakeup(&ticks);
+  tickcycles += r_time() - start;
   release(&tickslock);
 }
 
@@ -3,6 +3,7 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "spinlock.h"
 #include "defs.h"
 #include "fs.h"
 
@@ -16,6 +17,11 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+// Serializes sharing a page in uvmcopy() with uvmcow() deciding
+// whether a page is still shared, so a fork can't add a sharer
+// behind the back of a fault that is making the page writable.
+struct spinlock cowlock;
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
@@ -44,8 +50,8 @@ kvmmake(void)
   // the highest virtual address in the kernel.
   kvmmap(kpgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
-  // map kernel stacks
-  proc_mapstacks(kpgtbl);
+  // kernel stacks are kalloc()'d pages, already mapped above,
+  // taken as allocthread() needs them.
   
   return kpgtbl;
 }
@@ -55,6 +61,7 @@ void
 kvminit(void)
 {
   kernel_pagetable = kvmmake();
+  initlock(&cowlock, "cow");
 }
 
 // Switch h/w page table register to the kernel's page table,
@@ -162,33 +169,54 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
   return 0;
 }
 
-// Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
-// Optionally free the physical memory.
-void
-uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
+static void
+unmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free, int lazy)
 {
   uint64 a;
-  pte_t *pte;
+  pte_t *pte, e;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
+    if((pte = walk(pagetable, a, 0)) == 0){
+      if(lazy)
+        continue;
       panic("uvmunmap: walk");
-    if((*pte & PTE_V) == 0)
+    }
+    if((*pte & PTE_V) == 0){
+      if(lazy)
+        continue;
       panic("uvmunmap: not mapped");
+    }
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
-    if(do_free){
-      uint64 pa = PTE2PA(*pte);
-      kfree((void*)pa);
-    }
-    *pte = 0;
+    // swap, so a racing uvmcow() either sees the PTE gone
+    // or has already moved it to the page we free.
+    e = __sync_lock_test_and_set(pte, 0);
+    if(do_free)
+      kfree((void*)PTE2PA(e));
   }
 }
 
+// Remove npages of mappings starting from va. va must be
+// page-aligned. The mappings must exist.
+// Optionally free the physical memory.
+void
+uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
+{
+  unmap(pagetable, va, npages, do_free, 0);
+}
+
+// Like uvmunmap(), for ranges that sbrk() grows lazily: pages
+// that were reserved but never touched have no mapping, and are
+// skipped.
+void
+uvmunmap_lazy(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
+{
+  unmap(pagetable, va, npages, do_free, 1);
+}
+
 // create an empty user page table.
 // returns 0 if out of memory.
 pagetable_t
@@ -263,7 +291,7 @@ uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 
   if(PGROUNDUP(newsz) < PGROUNDUP(oldsz)){
     int npages = (PGROUNDUP(oldsz) - PGROUNDUP(newsz)) / PGSIZE;
-    uvmunmap(pagetable, PGROUNDUP(newsz), npages, 1);
+    uvmunmap_lazy(pagetable, PGROUNDUP(newsz), npages, 1);
   }
 
   return newsz;
@@ -295,48 +323,117 @@ void
 uvmfree(pagetable_t pagetable, uint64 sz)
 {
   if(sz > 0)
-    uvmunmap(pagetable, 0, PGROUNDUP(sz)/PGSIZE, 1);
+    uvmunmap_lazy(pagetable, 0, PGROUNDUP(sz)/PGSIZE, 1);
   freewalk(pagetable);
 }
 
-// Given a parent process's page table, copy
-// its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Given a parent process's page table, share its memory from
+// start to end with a child's page table, copy-on-write: writable pages
+// become read-only PTE_COW pages in both, and the first store
+// to one gets a private copy (see uvmcow()). Only page-table
+// pages are allocated. Other CPUs may still hold writable TLB
+// entries for old, so the caller must tlb_shootdown() it.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
-uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
+uvmcopy(pagetable_t old, pagetable_t new, uint64 start, uint64 end)
 {
-  //printf("entered uvmcopy\n");
-  pte_t *pte;
+  pte_t *pte, e;
   uint64 pa, i;
-  uint flags;
-  char *mem;
 
-  for(i = 0; i < sz; i += PGSIZE){
+  for(i = start; i < end; i += PGSIZE){
     if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
-    pa = PTE2PA(*pte);
-    flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
+      continue; // never touched since sbrk()
+    acquire(&cowlock);
+    e = *pte;
+    if((e & PTE_V) == 0){
+      release(&cowlock);
+      continue;
+    }
+    if(e & PTE_W){
+      e = (e & ~PTE_W) | PTE_COW;
+      *pte = e;
+    }
+    pa = PTE2PA(e);
+    if(mappages(new, i, PGSIZE, pa, PTE_FLAGS(e)) != 0){
+      release(&cowlock);
       goto err;
     }
+    kdup((void*)pa);
+    release(&cowlock);
   }
-  //printf("exit uvmcopy\n");
   return 0;
 
  err:
-  uvmunmap(new, 0, i / PGSIZE, 1);
+  uvmunmap_lazy(new, start, (i - start) / PGSIZE, 1);
   return -1;
 }
 
+// Handle a store to the copy-on-write page holding va: copy it
+// if it is still shared, or just make it writable if every other
+// sharer has let go. Other threads may fault on the same page at
+// the same time; whoever installs a PTE first wins and the rest
+// find the page writable. Returns 0 if the store can be retried,
+// -1 if va isn't a COW page or we are out of memory.
+int
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte, e;
+  uint64 pa;
+  char *mem = 0;
+  int r = -1, moved = 0;
+
+  if(va >= MAXVA || (pte = walk(pagetable, PGROUNDDOWN(va), 0)) == 0)
+    return -1;
+  for(;;){
+    e = *pte;
+    if((e & (PTE_V|PTE_U)) != (PTE_V|PTE_U))
+      break;
+    if(e & PTE_W){ // someone else resolved it
+      r = 0;
+      break;
+    }
+    if((e & PTE_COW) == 0)
+      break;
+    pa = PTE2PA(e);
+    if(mem == 0 && krefs((void*)pa) > 1){
+      // copy outside the lock; the page is read-only everywhere.
+      if((mem = kalloc()) == 0)
+        break;
+      memmove(mem, (char*)pa, PGSIZE);
+    }
+
+    acquire(&cowlock);
+    if(krefs((void*)pa) == 1){ // the last sharer: keep the page
+      if(__sync_bool_compare_and_swap(pte, e, (e | PTE_W) & ~PTE_COW))
+        r = 0;
+    } else if(mem != 0){
+      if(__sync_bool_compare_and_swap(pte, e, PA2PTE(mem) | ((PTE_FLAGS(e) | PTE_W) & ~PTE_COW))){
+        mem = 0;
+        moved = 1;
+        r = 0;
+      }
+    }
+    release(&cowlock);
+    if(r == 0)
+      break;
+    if(mem != 0 && PTE2PA(*pte) != pa){ // copied the wrong page
+      kfree(mem);
+      mem = 0;
+    }
+  }
+
+  if(mem)
+    kfree(mem);
+  if(moved){
+    // other threads may still read the old page through their TLBs;
+    // wait them out before it can go to someone else.
+    tlb_shootdown(pagetable);
+    kfree((void*)pa);
+  }
+  return r;
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -357,16 +454,35 @@ int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if(va0 >= MAXVA)
+      return -1;
+    pte = walk(pagetable, va0, 0);
+    if(pte == 0 || (*pte & PTE_V) == 0){
+      if(lazyfault(pagetable, va0, 1) < 0)
+        return -1;
+      pte = walk(pagetable, va0, 0);
+    }
+    if((*pte & PTE_U) == 0)
       return -1;
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
+    // hold cowlock while writing, so that a fork by another thread
+    // can't write-protect the page, and a COW fault move it, under us.
+    acquire(&cowlock);
+    while((*pte & PTE_W) == 0){
+      release(&cowlock);
+      if(uvmcow(pagetable, va0) < 0)
+        return -1;
+      acquire(&cowlock);
+    }
+    pa0 = PTE2PA(*pte);
     memmove((void *)(pa0 + (dstva - va0)), src, n);
+    release(&cowlock);
 
     len -= n;
     src += n;
@@ -386,6 +502,8 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
+    if(pa0 == 0 && lazyfault(pagetable, va0, 0) == 0)
+      pa0 = walkaddr(pagetable, va0);  // first touch since sbrk()
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -413,6 +531,8 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
+    if(pa0 == 0 && lazyfault(pagetable, va0, 0) == 0)
+      pa0 = walkaddr(pagetable, va0);  // first touch since sbrk()
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
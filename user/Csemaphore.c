@@ -14,14 +14,8 @@
 #include "kernel/proc.h"         // NEW INCLUDE FOR ASS 2, has all the signal definitions and sigaction definition.  Alternatively, copy the relevant things into user.h and include only it, and then no need to include spinlock.h .
 
 
-void csem_down(struct counting_semaphore *sem){
-    bsem_down(sem->S2);
-    bsem_down(sem->S1);
-    sem->value--;
-    if(sem->value > 0){
-        bsem_up(sem->S2);
-    }
-    bsem_up(sem->S1);
+int csem_down(struct counting_semaphore *sem){
+    return ksem_down(sem->descriptor, 1);
 }
 /*
 If the value representing the count of the semaphore variable is not negative,
@@ -31,31 +25,26 @@ continues execution.
 */
 
 void csem_up(struct counting_semaphore *sem){
-    bsem_down(sem->S1);
-    sem->value++;
-    if(sem->value == 1){
-        bsem_up(sem->S2);
-    }
-    bsem_up(sem->S1);
+    ksem_up(sem->descriptor, 1);
 }
 /*
 Increments the value of the semaphore variable by 1. As before, you are free to build
 the struct counting_semaphore as you wish.
 */
 
+int csem_down_many(struct counting_semaphore *sem, int n){
+    return ksem_down(sem->descriptor, n);
+}
+
+void csem_up_many(struct counting_semaphore *sem, int n){
+    ksem_up(sem->descriptor, n);
+}
+
 int csem_alloc(struct counting_semaphore *sem, int initial_value){
-    sem->value = initial_value; //should add validations on this value?
-    sem->S1 = bsem_alloc();
-    if(sem->S1 == -1){
-        return -1;
-    }
-    sem->S2 = bsem_alloc();
-    if(sem->S2 == -1){
+    sem->descriptor = ksem_alloc(initial_value);
+    if(sem->descriptor == -1){
         return -1;
     }
-    if (initial_value == 0){
-        bsem_down(sem->S2);
-    }
     return 0;
 }
 /*
@@ -64,9 +53,8 @@ success, another number otherwise.
 */
 
 void csem_free(struct counting_semaphore *sem){
-    sem->value = -1; //should add validations on this value?
-    bsem_free(sem->S1); 
-    bsem_free(sem->S2); 
+    ksem_free(sem->descriptor);
+    sem->descriptor = -1;
 }
 /*
 Frees semaphore.
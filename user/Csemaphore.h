@@ -1,17 +1,15 @@
 struct counting_semaphore{
-    int value;          //the number of threads can access the CS at the same time.
-    int S1;             //  protects the value; descriptor for binari semaphore
-    int S2;             //  protectes the actual entrance to the CS; descriptor for binari semaphore
+    int descriptor;     //  descriptor of the kernel counting semaphore (ksem_alloc)
 };
 
 
 
-void csem_down(struct counting_semaphore *sem);
+int csem_down(struct counting_semaphore *sem);
 /*
 If the value representing the count of the semaphore variable is not negative,
 decrement it by 1. If the semaphore variable is now negative, the thread executing
 acquire is blocked until the value is greater or equal to 1. Otherwise, the thread
-continues execution.
+continues execution. Returns 0, or -1 without taking a unit if the thread is killed.
 */
 
 void csem_up(struct counting_semaphore *sem);
@@ -20,6 +18,18 @@ Increments the value of the semaphore variable by 1. As before, you are free to
 the struct counting_semaphore as you wish.
 */
 
+int csem_down_many(struct counting_semaphore *sem, int n);
+/*
+Takes n units at once, blocking until all n are available. Waiters are served
+in arrival order, so a large request is not starved by smaller ones. Returns 0,
+or -1 without taking any if the thread is killed.
+*/
+
+void csem_up_many(struct counting_semaphore *sem, int n);
+/*
+Returns n units at once.
+*/
+
 int csem_alloc(struct counting_semaphore *sem, int initial_value);
 /*
 Allocates a new counting semaphore, and sets its initial value. Return value is 0 upon
@@ -0,0 +1,1064 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "kernel/riscv.h"
+#include "kernel/spinlock.h"
+#include "kernel/proc.h"
+#include "kernel/sysinfo.h"
+#include "kernel/bsem.h"
+#include "user/Csemaphore.h"
+#include "user/usync.h"
+
+//
+// Microbenchmarks for the scheduler and synchronization paths.
+// bench without arguments runs them all and bench <name> runs
+// <name>. Like usertests, each benchmark runs in its own child.
+// Most numbers only mean something when compared across kernels
+// or across CPUS= settings (e.g. make CPUS=1 qemu, make CPUS=8 qemu).
+//
+
+#define BENCH_TICKS 50  // how long each timed loop runs
+#define TIMEBASE_HZ 10000000  // rdtime frequency on qemu's virt machine
+
+// Context-switch throughput: NCPU pairs of processes bounce a
+// byte back and forth over two pipes until BENCH_TICKS pass.
+// Every round trip is two sleep/wakeup context switches.
+void
+ctxswitch(char *s)
+{
+  int res[2], a[2], b[2];
+  int npair = NCPU;
+  int i, n, total, start, end;
+  char c;
+
+  if(pipe(res) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  start = uptime();
+  end = start + BENCH_TICKS;
+  for(i = 0; i < npair; i++){
+    if(pipe(a) < 0 || pipe(b) < 0){
+      printf("%s: pipe failed\n", s);
+      exit(1);
+    }
+    if(fork() == 0){
+      // pong: echo until ping closes its end.
+      close(a[1]);
+      close(b[0]);
+      close(res[0]);
+      close(res[1]);
+      while(read(a[0], &c, 1) == 1)
+        write(b[1], &c, 1);
+      exit(0);
+    }
+    if(fork() == 0){
+      // ping: count round trips.
+      close(a[0]);
+      close(b[1]);
+      close(res[0]);
+      n = 0;
+      c = 0;
+      while(n % 64 != 0 || uptime() < end){
+        write(a[1], &c, 1);
+        read(b[0], &c, 1);
+        n++;
+      }
+      close(a[1]);
+      write(res[1], &n, sizeof(n));
+      exit(0);
+    }
+    close(a[0]);
+    close(a[1]);
+    close(b[0]);
+    close(b[1]);
+  }
+  close(res[1]);
+
+  total = 0;
+  while(read(res[0], &n, sizeof(n)) == sizeof(n))
+    total += n;
+  close(res[0]);
+  for(i = 0; i < 2*npair; i++)
+    wait(0);
+
+  end = uptime();
+  if(end == start)
+    end = start + 1;
+  printf("%d pairs, %d round trips in %d ticks, %d switches/tick\n",
+         npair, total, end - start, 2*total / (end - start));
+}
+
+// Clock-interrupt cost with a full proc table: fork until fork
+// fails, park every child in a pipe read, and report the average
+// rdtime cycles clockintr() spends per tick.
+void
+tickcost(char *s)
+{
+  int fds[2];
+  int n, pid;
+  uint64 dticks;
+  struct sysinfo before, after;
+  char c;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(n = 0; ; n++){
+    if((pid = fork()) < 0)
+      break;
+    if(pid == 0){
+      close(fds[1]);
+      read(fds[0], &c, 1);  // parked until the parent closes fds[1]
+      exit(0);
+    }
+  }
+
+  sysinfo(&before);
+  sleep(BENCH_TICKS);
+  sysinfo(&after);
+
+  close(fds[0]);
+  close(fds[1]);
+  while(wait(0) >= 0)
+    ;
+
+  dticks = after.ticks - before.ticks;
+  if(dticks == 0)
+    dticks = 1;
+  printf("%d children parked, %d cycles/tick\n",
+         n, (int)((after.tickcycles - before.tickcycles) / dticks));
+}
+
+// bsemhandoff: NTHREAD-1 threads of one process contend for a
+// single binary semaphore. Each holds it for a moment and reports
+// how many times it got it and the longest bsem_down() wait in
+// rdtime cycles. A FIFO semaphore keeps the worst case within a
+// few hold times of the mean; an unfair one lets it grow with the
+// run length. The semaphore's spin/sleep counters show how often
+// bsem_down() got away without a context switch.
+#define NHANDOFF (NTHREAD-1)
+
+int handoff_sem;
+volatile int handoff_stop;
+int handoff_next;
+int handoff_ops[NHANDOFF];
+uint64 handoff_maxwait[NHANDOFF];
+
+void
+handoff_worker()
+{
+  int me = __sync_fetch_and_add(&handoff_next, 1);
+  uint64 t0, w;
+  volatile int spin;
+
+  while(!handoff_stop){
+    t0 = rdtime();
+    bsem_down(handoff_sem);
+    w = rdtime() - t0;
+    if(w > handoff_maxwait[me])
+      handoff_maxwait[me] = w;
+    handoff_ops[me]++;
+    for(spin = 0; spin < 100; spin++)
+      ;
+    bsem_up(handoff_sem);
+  }
+  kthread_exit(0);
+}
+
+void
+bsemhandoff(char *s)
+{
+  int tids[NHANDOFF];
+  int i, status, total, start, end;
+  uint64 worst;
+  void *stack;
+  struct bsemstat st;
+
+  if((handoff_sem = bsem_alloc()) < 0){
+    printf("%s: bsem_alloc failed\n", s);
+    exit(1);
+  }
+  start = uptime();
+  for(i = 0; i < NHANDOFF; i++){
+    if((stack = malloc(MAX_STACK_SIZE)) == 0 ||
+       (tids[i] = kthread_create(handoff_worker, stack, 0)) < 0){
+      printf("%s: kthread_create failed\n", s);
+      exit(1);
+    }
+  }
+  sleep(BENCH_TICKS);
+  handoff_stop = 1;
+  for(i = 0; i < NHANDOFF; i++)
+    kthread_join(tids[i], &status);
+  end = uptime();
+  if(bsem_stat(handoff_sem, &st) < 0){
+    printf("%s: bsem_stat failed\n", s);
+    exit(1);
+  }
+  bsem_free(handoff_sem);
+
+  total = 0;
+  worst = 0;
+  for(i = 0; i < NHANDOFF; i++){
+    total += handoff_ops[i];
+    if(handoff_maxwait[i] > worst)
+      worst = handoff_maxwait[i];
+  }
+  if(end == start)
+    end = start + 1;
+  printf("%d threads, %d ops/tick, worst wait %d cycles, %d spins %d sleeps\n",
+         NHANDOFF, total / (end - start), (int)worst,
+         (int)st.spins, (int)st.sleeps);
+}
+
+// Handoff latency: two threads take turns through a pair of
+// binary semaphores. Each bsem_up() wakes a thread that is
+// asleep in bsem_down(); the woken thread reports the rdtime
+// cycles from just before the bsem_up() to its return from
+// bsem_down(). Run once in each bsem_sethandoff() mode.
+#define NPINGPONG 2000
+
+int pp_sem[2];
+volatile uint64 pp_stamp;
+uint64 pp_total[2], pp_max[2];
+
+// Side me downs pp_sem[me] and ups the other side's.
+void
+pp_side(int me)
+{
+  uint64 w;
+  int i;
+
+  for(i = 0; i < NPINGPONG; i++){
+    bsem_down(pp_sem[me]);
+    w = rdtime() - pp_stamp;
+    if(me == 0 || i > 0){ // side 1's first wait includes thread start
+      pp_total[me] += w;
+      if(w > pp_max[me])
+        pp_max[me] = w;
+    }
+    pp_stamp = rdtime();
+    bsem_up(pp_sem[!me]);
+  }
+}
+
+void
+pp_thread()
+{
+  pp_side(1);
+  kthread_exit(0);
+}
+
+void
+handofflat(char *s)
+{
+  static char *names[] = {
+    [BSEM_WAKE] "wake",
+    [BSEM_HANDOFF_QUEUE] "front",
+    [BSEM_HANDOFF_YIELD] "yield",
+  };
+  int mode, i, tid, status;
+  void *stack;
+
+  if((stack = malloc(MAX_STACK_SIZE)) == 0){
+    printf("%s: malloc failed\n", s);
+    exit(1);
+  }
+  printf("cycles");
+  for(mode = BSEM_WAKE; mode <= BSEM_HANDOFF_YIELD; mode++){
+    for(i = 0; i < 2; i++){
+      // both start out held, so every bsem_down() below sleeps
+      // until the other side's bsem_up().
+      if((pp_sem[i] = bsem_alloc()) < 0 || bsem_sethandoff(pp_sem[i], mode) < 0){
+        printf("\n%s: bsem_alloc failed\n", s);
+        exit(1);
+      }
+      bsem_down(pp_sem[i]);
+      pp_total[i] = pp_max[i] = 0;
+    }
+    if((tid = kthread_create(pp_thread, stack, 0)) < 0){
+      printf("\n%s: kthread_create failed\n", s);
+      exit(1);
+    }
+    pp_stamp = rdtime();
+    bsem_up(pp_sem[1]);
+    pp_side(0);
+    kthread_join(tid, &status);
+    for(i = 0; i < 2; i++)
+      bsem_free(pp_sem[i]);
+    printf(" %s avg %d max %d", names[mode],
+           (int)((pp_total[0] + pp_total[1]) / (2*NPINGPONG - 1)),
+           (int)(pp_max[0] > pp_max[1] ? pp_max[0] : pp_max[1]));
+  }
+  printf("\n");
+}
+
+// The counting semaphore as it was before csem moved into the
+// kernel: two binary semaphores and a shared count, four
+// syscalls per operation. Kept here for comparison.
+struct bcsem {
+  int value;
+  int s1;   // protects value
+  int s2;   // held while value == 0
+};
+
+int
+bcsem_alloc(struct bcsem *sem, int value)
+{
+  sem->value = value;
+  if((sem->s1 = bsem_alloc()) < 0 || (sem->s2 = bsem_alloc()) < 0)
+    return -1;
+  if(value == 0)
+    bsem_down(sem->s2);
+  return 0;
+}
+
+void
+bcsem_free(struct bcsem *sem)
+{
+  bsem_free(sem->s1);
+  bsem_free(sem->s2);
+}
+
+void
+bcsem_down(struct bcsem *sem)
+{
+  bsem_down(sem->s2);
+  bsem_down(sem->s1);
+  sem->value--;
+  if(sem->value > 0)
+    bsem_up(sem->s2);
+  bsem_up(sem->s1);
+}
+
+void
+bcsem_up(struct bcsem *sem)
+{
+  bsem_down(sem->s1);
+  sem->value++;
+  if(sem->value == 1)
+    bsem_up(sem->s2);
+  bsem_up(sem->s1);
+}
+
+// Uncontended lock/unlock pairs, in rdtime cycles per pair: the
+// futex-based umutex and usem, which stay in user space, against
+// the kernel csem (one syscall per operation) and the bsem-based
+// bcsem (four).
+#define NLOCKPAIR 20000
+
+void
+uncontended(char *s)
+{
+  struct umutex m;
+  struct usem sem;
+  struct counting_semaphore cs;
+  struct bcsem bcs;
+  uint64 t0, tm, ts, tc, tb;
+  int i;
+
+  umutex_init(&m);
+  t0 = rdtime();
+  for(i = 0; i < NLOCKPAIR; i++){
+    umutex_lock(&m);
+    umutex_unlock(&m);
+  }
+  tm = rdtime() - t0;
+
+  usem_init(&sem, 1);
+  t0 = rdtime();
+  for(i = 0; i < NLOCKPAIR; i++){
+    usem_down(&sem);
+    usem_up(&sem);
+  }
+  ts = rdtime() - t0;
+
+  if(csem_alloc(&cs, 1) < 0){
+    printf("%s: csem_alloc failed\n", s);
+    exit(1);
+  }
+  t0 = rdtime();
+  for(i = 0; i < NLOCKPAIR; i++){
+    csem_down(&cs);
+    csem_up(&cs);
+  }
+  tc = rdtime() - t0;
+  csem_free(&cs);
+
+  if(bcsem_alloc(&bcs, 1) < 0){
+    printf("%s: bcsem_alloc failed\n", s);
+    exit(1);
+  }
+  t0 = rdtime();
+  for(i = 0; i < NLOCKPAIR; i++){
+    bcsem_down(&bcs);
+    bcsem_up(&bcs);
+  }
+  tb = rdtime() - t0;
+  bcsem_free(&bcs);
+
+  printf("cycles/pair umutex %d usem %d csem %d bcsem %d\n",
+         (int)(tm / NLOCKPAIR), (int)(ts / NLOCKPAIR), (int)(tc / NLOCKPAIR),
+         (int)(tb / NLOCKPAIR));
+}
+
+// Bounded buffer: a producer thread and the main thread pass
+// NBBITEM ints through an NBBSLOT ring guarded by an "empty" and
+// a "full" semaphore. Runs once with bcsem, once with the kernel
+// csem, and once with csem moving NBBBATCH slots per call.
+#define NBBSLOT   16
+#define NBBITEM   20000
+#define NBBBATCH  8
+
+enum { BB_BCSEM, BB_CSEM, BB_BATCH };
+
+int bb_mode;
+int bb_ring[NBBSLOT];
+struct bcsem bb_bempty, bb_bfull;
+struct counting_semaphore bb_empty, bb_full;
+
+void
+bb_down(int full, int n)
+{
+  int i;
+
+  switch(bb_mode){
+  case BB_BCSEM:
+    for(i = 0; i < n; i++)
+      bcsem_down(full ? &bb_bfull : &bb_bempty);
+    break;
+  case BB_CSEM:
+    for(i = 0; i < n; i++)
+      csem_down(full ? &bb_full : &bb_empty);
+    break;
+  case BB_BATCH:
+    csem_down_many(full ? &bb_full : &bb_empty, n);
+    break;
+  }
+}
+
+void
+bb_up(int full, int n)
+{
+  int i;
+
+  switch(bb_mode){
+  case BB_BCSEM:
+    for(i = 0; i < n; i++)
+      bcsem_up(full ? &bb_bfull : &bb_bempty);
+    break;
+  case BB_CSEM:
+    for(i = 0; i < n; i++)
+      csem_up(full ? &bb_full : &bb_empty);
+    break;
+  case BB_BATCH:
+    csem_up_many(full ? &bb_full : &bb_empty, n);
+    break;
+  }
+}
+
+void
+bb_producer()
+{
+  int i, j;
+
+  for(i = 0; i < NBBITEM; i += NBBBATCH){
+    bb_down(0, NBBBATCH);
+    for(j = i; j < i + NBBBATCH; j++)
+      bb_ring[j % NBBSLOT] = j;
+    bb_up(1, NBBBATCH);
+  }
+  kthread_exit(0);
+}
+
+// returns rdtime cycles per item.
+int
+bb_run(char *s, int mode)
+{
+  int i, j, tid, status;
+  uint64 t0;
+  void *stack;
+
+  bb_mode = mode;
+  if(mode == BB_BCSEM){
+    if(bcsem_alloc(&bb_bempty, NBBSLOT) < 0 || bcsem_alloc(&bb_bfull, 0) < 0){
+      printf("%s: bcsem_alloc failed\n", s);
+      exit(1);
+    }
+  } else if(csem_alloc(&bb_empty, NBBSLOT) < 0 || csem_alloc(&bb_full, 0) < 0){
+    printf("%s: csem_alloc failed\n", s);
+    exit(1);
+  }
+  if((stack = malloc(MAX_STACK_SIZE)) == 0){
+    printf("%s: malloc failed\n", s);
+    exit(1);
+  }
+
+  t0 = rdtime();
+  if((tid = kthread_create(bb_producer, stack, 0)) < 0){
+    printf("%s: kthread_create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NBBITEM; i += NBBBATCH){
+    bb_down(1, NBBBATCH);
+    for(j = i; j < i + NBBBATCH; j++){
+      if(bb_ring[j % NBBSLOT] != j){
+        printf("%s: item %d out of order\n", s, j);
+        exit(1);
+      }
+    }
+    bb_up(0, NBBBATCH);
+  }
+  kthread_join(tid, &status);
+  t0 = rdtime() - t0;
+
+  free(stack);
+  if(mode == BB_BCSEM){
+    bcsem_free(&bb_bempty);
+    bcsem_free(&bb_bfull);
+  } else {
+    csem_free(&bb_empty);
+    csem_free(&bb_full);
+  }
+  return t0 / NBBITEM;
+}
+
+void
+boundedbuf(char *s)
+{
+  int b, c, m;
+
+  b = bb_run(s, BB_BCSEM);
+  c = bb_run(s, BB_CSEM);
+  m = bb_run(s, BB_BATCH);
+  printf("cycles/item bcsem %d csem %d csem batch %d\n", b, c, m);
+}
+
+// grow the heap by npages and touch every page, so that fork has
+// something to copy.
+void
+growheap(char *s, int npages)
+{
+  char *a;
+  int i;
+
+  if((a = sbrk(npages * PGSIZE)) == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < npages; i++)
+    a[i * PGSIZE] = i;
+}
+
+// fork+exec+exit+wait latency in rdtime cycles, with a small
+// parent and again with NHEAPPAGES of heap. With copy-on-write
+// fork the two should be close; an eager copy pays for every
+// page of the parent even though the child execs right away.
+#define NFORKEXEC  50
+#define NHEAPPAGES 1024
+
+uint64
+forkexec1(char *s)
+{
+  char *argv[] = { "bench", "-exit", 0 };
+  uint64 t0;
+  int i, pid;
+
+  t0 = rdtime();
+  for(i = 0; i < NFORKEXEC; i++){
+    if((pid = fork()) < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      exec("bench", argv);
+      printf("%s: exec failed\n", s);
+      exit(1);
+    }
+    wait(0);
+  }
+  return (rdtime() - t0) / NFORKEXEC;
+}
+
+void
+forkexec(char *s)
+{
+  uint64 small, big;
+
+  small = forkexec1(s);
+  growheap(s, NHEAPPAGES);
+  big = forkexec1(s);
+  printf("cycles/fork+exec %d, with %d more heap pages %d\n",
+         (int)small, NHEAPPAGES, (int)big);
+}
+
+// Memory footprint of fork: NCOWCHILD children of a parent with
+// NHEAPPAGES of heap park in a pipe read. Report how many physical
+// pages each child costs, then how many after each child has
+// written a quarter of the heap.
+#define NCOWCHILD 4
+
+void
+cowmem(char *s)
+{
+  int go[2], done[2];
+  int i, j, pid;
+  char *heap, c;
+  struct sysinfo before, forked, written;
+
+  growheap(s, NHEAPPAGES);
+  heap = sbrk(0) - NHEAPPAGES * PGSIZE;
+  if(pipe(go) < 0 || pipe(done) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  sysinfo(&before);
+  for(i = 0; i < NCOWCHILD; i++){
+    if((pid = fork()) < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(go[1]);
+      close(done[0]);
+      read(go[0], &c, 1);
+      for(j = 0; j < NHEAPPAGES / 4; j++)
+        heap[j * PGSIZE] = j + 1;
+      write(done[1], &c, 1);
+      read(go[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(go[0]);
+  close(done[1]);
+  sysinfo(&forked);
+
+  for(i = 0; i < NCOWCHILD; i++)
+    write(go[1], &c, 1);
+  for(i = 0; i < NCOWCHILD; i++)
+    read(done[0], &c, 1);
+  sysinfo(&written);
+
+  close(go[1]);
+  for(i = 0; i < NCOWCHILD; i++)
+    wait(0);
+  printf("heap %d pages, pages/child %d after fork, %d after writing %d\n",
+         NHEAPPAGES,
+         (int)((before.freepages - forked.freepages) / NCOWCHILD),
+         (int)((before.freepages - written.freepages) / NCOWCHILD),
+         NHEAPPAGES / 4);
+}
+
+// Thread churn: create NTHREAD-1 threads that exit at once and
+// join them, over and over, until BENCH_TICKS pass. Reports
+// created+joined threads per second.
+void
+churn_thread()
+{
+  kthread_exit(0);
+}
+
+void
+threadchurn(char *s)
+{
+  void *stacks[NTHREAD-1];
+  int tids[NTHREAD-1];
+  int i, n, status, end;
+  uint64 t0;
+
+  for(i = 0; i < NTHREAD-1; i++){
+    if((stacks[i] = malloc(MAX_STACK_SIZE)) == 0){
+      printf("%s: malloc failed\n", s);
+      exit(1);
+    }
+  }
+  n = 0;
+  t0 = rdtime();
+  end = uptime() + BENCH_TICKS;
+  while(uptime() < end){
+    for(i = 0; i < NTHREAD-1; i++){
+      if((tids[i] = kthread_create(churn_thread, stacks[i], 0)) < 0){
+        printf("%s: kthread_create failed\n", s);
+        exit(1);
+      }
+    }
+    for(i = 0; i < NTHREAD-1; i++)
+      kthread_join(tids[i], &status);
+    n += NTHREAD-1;
+  }
+  printf("%d threads/sec\n", (int)((uint64)n * TIMEBASE_HZ / (rdtime() - t0)));
+}
+
+// malloc/free throughput as threads are added: each of 1, 2, 4 ...
+// NCPU threads keeps MALLOC_LIVE blocks of 16 to 1024 bytes and
+// replaces one at a time until MALLOC_TICKS pass.
+#define MALLOC_LIVE  64
+#define MALLOC_TICKS 20
+
+volatile int malloc_stop;
+uint64 malloc_ops[NCPU];
+int malloc_next;
+
+void
+malloc_worker()
+{
+  int me = __sync_fetch_and_add(&malloc_next, 1);
+  void *live[MALLOC_LIVE];
+  uint r = me + 1;
+  uint64 n = 0;
+  int i;
+
+  for(i = 0; i < MALLOC_LIVE; i++)
+    live[i] = malloc(16);
+  while(!malloc_stop){
+    for(i = 0; i < MALLOC_LIVE; i++){
+      r = r * 1103515245 + 12345;
+      free(live[i]);
+      live[i] = malloc(16 << ((r >> 16) % 7));
+    }
+    n += MALLOC_LIVE;
+  }
+  for(i = 0; i < MALLOC_LIVE; i++)
+    free(live[i]);
+  malloc_ops[me] = n;
+  malloc_flush();
+  kthread_exit(0);
+}
+
+void
+mallocscale(char *s)
+{
+  int tids[NCPU];
+  void *stacks[NCPU];
+  int i, n, status;
+  uint64 t0, ops;
+
+  for(n = 1; n <= NCPU && n < NTHREAD; n *= 2){
+    malloc_stop = 0;
+    malloc_next = 0;
+    t0 = rdtime();
+    for(i = 0; i < n; i++){
+      stacks[i] = malloc(MAX_STACK_SIZE);
+      if((tids[i] = kthread_create(malloc_worker, stacks[i], tls_alloc())) < 0){
+        printf("%s: kthread_create failed\n", s);
+        exit(1);
+      }
+    }
+    sleep(MALLOC_TICKS);
+    malloc_stop = 1;
+    ops = 0;
+    for(i = 0; i < n; i++){
+      kthread_join(tids[i], &status);
+      ops += malloc_ops[i];
+      free(stacks[i]);
+    }
+    ops = ops * TIMEBASE_HZ / (rdtime() - t0);
+    printf("%d threads: %d ops/sec, %d per thread\n", n, (int)ops, (int)(ops / n));
+  }
+}
+
+// Page allocator stress: NCPU processes each grow the heap by
+// NSTRESSPAGES, touch every page (one kalloc() each, via lazy
+// sbrk) and shrink it again (one kfree() each), until BENCH_TICKS
+// pass. Reports pages allocated and freed per second per process;
+// with one process per hart, that is per hart.
+#define NSTRESSPAGES 64
+
+void
+kallocstress(char *s)
+{
+  int res[2];
+  int i, n, total, end;
+  uint64 t0, cycles;
+  char *a;
+
+  if(pipe(res) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  t0 = rdtime();
+  end = uptime() + BENCH_TICKS;
+  for(i = 0; i < NCPU; i++){
+    if(fork() == 0){
+      close(res[0]);
+      n = 0;
+      while(uptime() < end){
+        if((a = sbrk(NSTRESSPAGES * PGSIZE)) == (char*)-1){
+          printf("%s: sbrk failed\n", s);
+          exit(1);
+        }
+        for(int j = 0; j < NSTRESSPAGES; j++)
+          a[j * PGSIZE] = 1;
+        sbrk(-NSTRESSPAGES * PGSIZE);
+        n += NSTRESSPAGES;
+      }
+      write(res[1], &n, sizeof(n));
+      exit(0);
+    }
+  }
+  close(res[1]);
+  total = 0;
+  while(read(res[0], &n, sizeof(n)) == sizeof(n))
+    total += n;
+  close(res[0]);
+  for(i = 0; i < NCPU; i++)
+    wait(0);
+  cycles = rdtime() - t0;
+  printf("%d procs, %d pages/sec per proc\n", NCPU,
+         (int)((uint64)total * TIMEBASE_HZ / cycles / NCPU));
+}
+
+// Null system call round trip: getpid() does no work in the
+// kernel, so this is the cost of a trap into the kernel and
+// usertrapret() back out, signal check included. In rdtime
+// cycles and nanoseconds per call.
+#define NSYSCALL 100000
+
+void
+nullsyscall(char *s)
+{
+  uint64 t0, cycles;
+  int i;
+
+  getpid();
+  t0 = rdtime();
+  for(i = 0; i < NSYSCALL; i++)
+    getpid();
+  cycles = rdtime() - t0;
+  printf("%d calls, %d cycles/call, %d ns/call\n", NSYSCALL,
+         (int)(cycles / NSYSCALL),
+         (int)(cycles * (1000000000 / TIMEBASE_HZ) / NSYSCALL));
+}
+
+// Signal delivery rate: the process sends itself a signal that
+// has a handler, over and over. Each kill() returns to user space
+// through the handler and sigret(). In signals handled per second.
+#define SIGBENCH 12
+
+volatile int sigbench_n;
+
+void
+sigbench_handler(int signum)
+{
+  sigbench_n++;
+}
+
+void
+sigdeliver(char *s)
+{
+  struct sigaction act = {sigbench_handler, 0};
+  uint64 t0, cycles;
+  int n, end;
+
+  if(sigaction(SIGBENCH, &act, 0) < 0){
+    printf("%s: sigaction failed\n", s);
+    exit(1);
+  }
+  end = uptime() + BENCH_TICKS;
+  t0 = rdtime();
+  for(n = 0; n % 64 != 0 || uptime() < end; n++)
+    kill(getpid(), SIGBENCH);
+  cycles = rdtime() - t0;
+  if(sigbench_n != n){
+    printf("%s: sent %d signals, handled %d\n", s, n, sigbench_n);
+    exit(1);
+  }
+  printf("%d signals, %d signals/sec\n", n,
+         (int)((uint64)n * TIMEBASE_HZ / cycles));
+}
+
+// Fork scaling: fork children that park in a pipe read until
+// fork() fails or fewer than FORKRESERVE pages are left (kept so
+// the parent's own copy-on-write faults still succeed). Reports
+// how many processes that was, the pages each cost, and fork()'s
+// rdtime cycles over the first and the last FORKBATCH forks; with
+// no fixed process table the two should be about the same.
+#define FORKBATCH   64
+#define FORKRESERVE 64
+
+void
+forkbomb(char *s)
+{
+  int fds[2];
+  int n, pid;
+  uint64 t0, now, first, last;
+  struct sysinfo before, info;
+  char c;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  sysinfo(&before);
+  first = last = 0;
+  t0 = rdtime();
+  for(n = 0; ; n++){
+    if(n > 0 && n % FORKBATCH == 0){
+      now = rdtime();
+      last = now - t0;
+      if(n == FORKBATCH)
+        first = last;
+      t0 = now;
+    }
+    sysinfo(&info);
+    if(info.freepages < FORKRESERVE)
+      break;
+    if((pid = fork()) < 0)
+      break;
+    if(pid == 0){
+      close(fds[1]);
+      read(fds[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  while(wait(0) >= 0)
+    ;
+  if(n < FORKBATCH){
+    printf("%s: only %d forks\n", s, n);
+    exit(1);
+  }
+  printf("%d procs, %d pages/proc, cycles/fork %d first, %d last\n",
+         n, (int)((before.freepages - info.freepages) / n),
+         (int)(first / FORKBATCH), (int)(last / FORKBATCH));
+}
+
+// Interactive response time next to CPU hogs: a child wakes once
+// a tick and writes the rdtime it woke at into a pipe, and the
+// reader notes how long it took to run after that. Reports the
+// 50th and 99th percentile over NRESP wakeups, in microseconds,
+// first alone and then with NHOG CPU-bound processes, which the
+// scheduler should have moved below the reader's level.
+#define NRESP 100
+#define NHOG  (2*NCPU)
+
+void
+resp_round(char *s, int nhog)
+{
+  int fds[2], hogs[NHOG];
+  uint64 lat[NRESP], stamp, x;
+  int i, j, pid;
+
+  for(i = 0; i < nhog; i++){
+    if((hogs[i] = fork()) < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(hogs[i] == 0)
+      for(;;)
+        ;
+  }
+  if(pipe(fds) < 0 || (pid = fork()) < 0){
+    printf("%s: pipe or fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(i = 0; i < NRESP; i++){
+      sleep(1);
+      stamp = rdtime();
+      write(fds[1], &stamp, sizeof(stamp));
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  for(i = 0; i < NRESP; i++){
+    if(read(fds[0], &stamp, sizeof(stamp)) != sizeof(stamp)){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+    lat[i] = rdtime() - stamp;
+  }
+  close(fds[0]);
+  for(i = 0; i < nhog; i++)
+    kill(hogs[i], SIGKILL);
+  for(i = 0; i < nhog + 1; i++)
+    wait(0);
+
+  for(i = 1; i < NRESP; i++){
+    x = lat[i];
+    for(j = i; j > 0 && lat[j-1] > x; j--)
+      lat[j] = lat[j-1];
+    lat[j] = x;
+  }
+  printf("%d hogs: p50 %d us, p99 %d us\n", nhog,
+         (int)(lat[NRESP / 2] * 1000000 / TIMEBASE_HZ),
+         (int)(lat[NRESP * 99 / 100] * 1000000 / TIMEBASE_HZ));
+}
+
+void
+interactive(char *s)
+{
+  resp_round(s, 0);
+  resp_round(s, NHOG);
+}
+
+// run each benchmark in its own process.
+void
+run(void f(char *), char *s)
+{
+  int pid;
+  int xstatus;
+
+  printf("bench %s: ", s);
+  if((pid = fork()) < 0){
+    printf("runbench: fork error\n");
+    exit(1);
+  }
+  if(pid == 0){
+    f(s);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    printf("FAILED\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *justone = 0;
+
+  if(argc == 2 && strcmp(argv[1], "-exit") == 0)
+    exit(0);  // the child that forkexec execs
+  if(argc == 2 && argv[1][0] != '-'){
+    justone = argv[1];
+  } else if(argc > 1){
+    printf("Usage: bench [name]\n");
+    exit(1);
+  }
+
+  struct bench {
+    void (*f)(char *);
+    char *s;
+  } benches[] = {
+    {ctxswitch, "ctxswitch"},
+    {tickcost, "tickcost"},
+    {bsemhandoff, "bsemhandoff"},
+    {handofflat, "handofflat"},
+    {uncontended, "uncontended"},
+    {boundedbuf, "boundedbuf"},
+    {forkexec, "forkexec"},
+    {cowmem, "cowmem"},
+    {kallocstress, "kallocstress"},
+    {threadchurn, "threadchurn"},
+    {mallocscale, "mallocscale"},
+    {nullsyscall, "nullsyscall"},
+    {sigdeliver, "sigdeliver"},
+    {forkbomb, "forkbomb"},
+    {interactive, "interactive"},
+    { 0, 0},
+  };
+
+  for(struct bench *b = benches; b->s != 0; b++){
+    if(justone == 0 || strcmp(b->s, justone) == 0)
+      run(b->f, b->s);
+  }
+  exit(0);
+}
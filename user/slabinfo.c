@@ -0,0 +1,22 @@
+// Print the kernel's slab cache counters, and how many pages
+// each cache saves over giving every object a page of its own.
+
+#include "kernel/types.h"
+#include "kernel/sysinfo.h"
+#include "user/user.h"
+
+int
+main(void)
+{
+  struct slabstat st;
+  int i;
+
+  printf("cache\tsize\tper\tslabs\tinuse\tcached\tallocs\thits\tsaved\n");
+  for(i = 0; slabstat(i, &st) == 0; i++){
+    printf("%s\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n", st.name,
+           (int)st.objsize, (int)st.perslab, (int)st.slabs,
+           (int)st.inuse, (int)st.cached, (int)st.allocs,
+           (int)st.hits, (int)st.inuse - (int)st.slabs);
+  }
+  exit(0);
+}
@@ -129,8 +129,24 @@ memcmp(const void *s1, const void *s2, uint n)
   return 0;
 }
 
+// read the time CSR; start.c lets user mode do this.
+uint64
+rdtime(void)
+{
+  uint64 x;
+  asm volatile("rdtime %0" : "=r" (x));
+  return x;
+}
+
 void *
 memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// wait for one of the signals in set with no time limit.
+int
+sigwaitinfo(uint set, struct siginfo *info)
+{
+  return sigtimedwait(set, info, -1);
+}
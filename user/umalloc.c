@@ -2,31 +2,64 @@
 #include "kernel/stat.h"
 #include "user/user.h"
 #include "kernel/param.h"
+#include "kernel/riscv.h"
+#include "user/usync.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Thread-safe memory allocator.
+//
+// Small blocks come in NCLASS power-of-two size classes. Each
+// thread with a TLS block keeps a cache of free blocks per class
+// and moves them to and from a central, locked list per class in
+// batches, so most malloc()/free() calls take no lock at all.
+// Threads without a TLS block use the central lists directly.
+//
+// Large blocks, and the chunks that small blocks are carved from,
+// come from the Kernighan and Ritchie allocator below (The C
+// Programming Language, 2nd ed., Section 8.7), which asks sbrk()
+// for just the pages it needs.
 
 typedef long Align;
 
 union header {
   struct {
-    union header *ptr;
-    uint size;
+    union header *ptr;  // next on a free list
+    uint size;          // in units of Header, or SMALL|class
   } s;
   Align x;
 };
 
 typedef union header Header;
 
+#define NCLASS   8
+#define MINCLASS 32            // bytes in a class 0 block, header included
+#define MAXSMALL (MINCLASS << (NCLASS-1))
+#define SMALL    0x80000000    // s.size of a small block: SMALL|class
+
+struct central {
+  struct umutex lock;
+  Header *free;
+  int n;
+} central[NCLASS];
+
+// A thread's cache, found through a pointer in its TLS block.
+struct tcache {
+  Header *free[NCLASS];
+  int n[NCLASS];
+};
+
+static int tcache_key = -1;    // offset in TLS blocks; -2 if none fit
+
+// Large blocks: K&R's free list, under biglock.
+
+static struct umutex biglock;
 static Header base;
 static Header *freep;
 
-void
-free(void *ap)
+static void
+bigfree(Header *bp)
 {
-  Header *bp, *p;
+  Header *p;
 
-  bp = (Header*)ap - 1;
   for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
     if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
       break;
@@ -49,24 +82,25 @@ morecore(uint nu)
   char *p;
   Header *hp;
 
-  if(nu < 4096)
-    nu = 4096;
+  nu = PGROUNDUP(nu * sizeof(Header)) / sizeof(Header);
   p = sbrk(nu * sizeof(Header));
   if(p == (char*)-1)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  bigfree(hp);
   return freep;
 }
 
-void*
-malloc(uint nbytes)
+// Allocate a block of nbytes from the K&R list. Returns its header.
+static Header*
+bigalloc(uint nbytes)
 {
   Header *p, *prevp;
   uint nunits;
 
   nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  umutex_lock(&biglock);
   if((prevp = freep) == 0){
     base.s.ptr = freep = prevp = &base;
     base.s.size = 0;
@@ -81,10 +115,214 @@ malloc(uint nbytes)
         p->s.size = nunits;
       }
       freep = prevp;
-      return (void*)(p + 1);
+      umutex_unlock(&biglock);
+      return p;
     }
     if(p == freep)
-      if((p = morecore(nunits)) == 0)
+      if((p = morecore(nunits)) == 0){
+        umutex_unlock(&biglock);
         return 0;
+      }
+  }
+}
+
+// Small blocks.
+
+static int
+sizeclass(uint nbytes)
+{
+  int c;
+
+  for(c = 0; (MINCLASS << c) < nbytes + sizeof(Header); c++)
+    ;
+  return c;
+}
+
+// Blocks a thread cache moves to or from the central list at once.
+static int
+batch(int c)
+{
+  int n = PGSIZE / (MINCLASS << c);
+
+  if(n < 4)
+    return 4;
+  if(n > 32)
+    return 32;
+  return n;
+}
+
+// Take up to n blocks of class c from the central list, carving
+// a fresh chunk if it is empty. Returns them linked through s.ptr
+// and sets *got to how many there are.
+static Header*
+central_get(int c, int n, int *got)
+{
+  struct central *ce = &central[c];
+  Header *h, *last, *chunk;
+  uint size = MINCLASS << c;
+  int i, nchunk;
+
+  umutex_lock(&ce->lock);
+  if(ce->free == 0){
+    nchunk = 2 * batch(c);
+    if((chunk = bigalloc(nchunk * size)) != 0){
+      // the chunk's own header is lost; the blocks start after it.
+      h = chunk + 1;
+      for(i = 0; i < nchunk; i++){
+        h->s.size = SMALL | c;
+        h->s.ptr = ce->free;
+        ce->free = h;
+        h = (Header*)((char*)h + size);
+      }
+      ce->n += nchunk;
+    }
+  }
+  h = ce->free;
+  for(i = 0, last = 0; i < n && ce->free; i++){
+    last = ce->free;
+    ce->free = last->s.ptr;
+  }
+  if(last)
+    last->s.ptr = 0;
+  ce->n -= i;
+  umutex_unlock(&ce->lock);
+  *got = i;
+  return i ? h : 0;
+}
+
+// Give n blocks of class c, linked from first to last, back to
+// the central list.
+static void
+central_put(int c, Header *first, Header *last, int n)
+{
+  struct central *ce = &central[c];
+
+  umutex_lock(&ce->lock);
+  last->s.ptr = ce->free;
+  ce->free = first;
+  ce->n += n;
+  umutex_unlock(&ce->lock);
+}
+
+// The calling thread's cache, or 0 if it has no TLS block.
+static struct tcache*
+mytcache(void)
+{
+  struct tcache **tcp;
+  Header *h;
+  char *tls;
+  int got;
+
+  asm volatile("mv %0, tp" : "=r" (tls));
+  if(tls == 0)
+    return 0;
+  if(tcache_key == -1){
+    umutex_lock(&biglock);
+    if(tcache_key == -1 && (tcache_key = tls_key(sizeof(*tcp))) < 0)
+      tcache_key = -2;
+    umutex_unlock(&biglock);
+  }
+  if(tcache_key < 0)
+    return 0;
+  tcp = (struct tcache**)(tls + tcache_key);
+  if(*tcp == 0){
+    if((h = central_get(sizeclass(sizeof(struct tcache)), 1, &got)) == 0)
+      return 0;
+    *tcp = (struct tcache*)(h + 1);
+    memset(*tcp, 0, sizeof(struct tcache));
+  }
+  return *tcp;
+}
+
+void
+free(void *ap)
+{
+  struct tcache *tc;
+  Header *bp, *last;
+  int c, i;
+
+  if(ap == 0)
+    return;
+  bp = (Header*)ap - 1;
+  if((bp->s.size & SMALL) == 0){
+    umutex_lock(&biglock);
+    bigfree(bp);
+    umutex_unlock(&biglock);
+    return;
+  }
+  c = bp->s.size & ~SMALL;
+  if((tc = mytcache()) == 0){
+    central_put(c, bp, bp, 1);
+    return;
+  }
+  bp->s.ptr = tc->free[c];
+  tc->free[c] = bp;
+  if(++tc->n[c] > 2 * batch(c)){
+    // keep the batch most recently freed, return the rest.
+    for(last = tc->free[c], i = 1; i < batch(c); i++)
+      last = last->s.ptr;
+    bp = last->s.ptr;
+    last->s.ptr = 0;
+    for(last = bp; last->s.ptr; last = last->s.ptr)
+      ;
+    central_put(c, bp, last, tc->n[c] - batch(c));
+    tc->n[c] = batch(c);
+  }
+}
+
+void*
+malloc(uint nbytes)
+{
+  struct tcache *tc;
+  Header *p;
+  int c, got;
+
+  if(nbytes > MAXSMALL - sizeof(Header)){
+    if((p = bigalloc(nbytes)) == 0)
+      return 0;
+    return (void*)(p + 1);
+  }
+  c = sizeclass(nbytes);
+  if((tc = mytcache()) == 0){
+    if((p = central_get(c, 1, &got)) == 0)
+      return 0;
+    return (void*)(p + 1);
+  }
+  if(tc->free[c] == 0){
+    if((tc->free[c] = central_get(c, batch(c), &got)) == 0)
+      return 0;
+    tc->n[c] = got;
+  }
+  p = tc->free[c];
+  tc->free[c] = p->s.ptr;
+  tc->n[c]--;
+  return (void*)(p + 1);
+}
+
+// Return the calling thread's cached blocks to the central lists,
+// e.g. before kthread_exit(), so they are not stranded.
+void
+malloc_flush(void)
+{
+  struct tcache *tc;
+  Header *last;
+  char *tls;
+  int c;
+
+  if((tc = mytcache()) == 0)
+    return;
+  for(c = 0; c < NCLASS; c++){
+    if(tc->free[c] == 0)
+      continue;
+    for(last = tc->free[c]; last->s.ptr; last = last->s.ptr)
+      ;
+    central_put(c, tc->free[c], last, tc->n[c]);
+    tc->free[c] = 0;
+    tc->n[c] = 0;
   }
+  asm volatile("mv %0, tp" : "=r" (tls));
+  *(struct tcache**)(tls + tcache_key) = 0;
+  // not free(), which would make the thread a new cache to hold it.
+  central_put(sizeclass(sizeof(struct tcache)), (Header*)tc - 1,
+              (Header*)tc - 1, 1);
 }
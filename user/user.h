@@ -1,9 +1,15 @@
 struct stat;
 struct rtcdate;
 struct sigaction;
+struct siginfo;
+struct sysinfo;
+struct bsemstat;
+struct slabstat;
+struct kthread_attr;
 
 
 #define MAX_STACK_SIZE       4000     // user stack max size
+#define TLS_SIZE             256      // bytes of thread-local storage per thread
 
 // system calls
 int fork(void);
@@ -14,6 +20,9 @@ int write(int, const void*, int);
 int read(int, void*, int);
 int close(int);
 int kill(int, int);
+int tkill(int, int);
+int sigqueue(int, int, int);
+int sigtimedwait(uint, struct siginfo*, int);
 int exec(char*, char**);
 int open(const char*, int);
 int mknod(const char*, short, short);
@@ -30,14 +39,29 @@ int uptime(void);
 uint sigprocmask(uint);
 int sigaction (int, const struct sigaction*, struct sigaction*);
 void sigret(void);
-int kthread_create ( void ( * ) ( ) , void *);
+int kthread_create ( void ( * ) ( ) , void *, void *);
 int kthread_id();
 void kthread_exit(int);
 int kthread_join(int, int*);
+int kthread_limit(int);
+int kthread_detach(int);
+int kthread_join_any(int*);
+int kthread_run(void (*)(), int (*)(void*), void*, struct kthread_attr*);
+int setpriority(int, int);
+int getpriority(int);
 int bsem_alloc();
 void bsem_free(int);
 void bsem_down(int);
 void bsem_up(int);
+int sysinfo(struct sysinfo*);
+int futex(volatile int*, int, int);
+int ksem_alloc(int);
+int ksem_free(int);
+int ksem_down(int, int);
+int ksem_up(int, int);
+int bsem_stat(int, struct bsemstat*);
+int bsem_sethandoff(int, int);
+int slabstat(int, struct slabstat*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -52,6 +76,21 @@ uint strlen(const char*);
 void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
+// a kthread_create() thread must call malloc_flush() before
+// kthread_exit(), or the blocks its cache holds are lost.
+void malloc_flush(void);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+uint64 rdtime(void);
+int sigwaitinfo(uint, struct siginfo*);
+
+// uthread.c
+void *tls_alloc(void);
+void *tls_self(void);
+int tls_key(uint);
+int kthread_spawn(int (*)(void*), void*, struct kthread_attr*);
+
+// The calling thread's copy of a thread-local variable of the
+// given type, at offset key (from tls_key()) in its TLS block.
+#define TLS(type, key) (*(type*)((char*)tls_self() + (key)))
@@ -12,6 +12,10 @@
 #include "kernel/spinlock.h"  // NEW INCLUDE FOR ASS2
 #include "Csemaphore.h"   // NEW INCLUDE FOR ASS 2
 #include "kernel/proc.h"         // NEW INCLUDE FOR ASS 2, has all the signal definitions and sigaction definition.  Alternatively, copy the relevant things into user.h and include only it, and then no need to include spinlock.h .
+#include "usync.h"
+#include "kernel/futex.h"
+#include "kernel/sysinfo.h"
+#include "kernel/kthread.h"
 
 
 //
@@ -64,7 +68,7 @@ void thread_test(char *s){
     int tid;
     int status;
     void* stack = malloc(MAX_STACK_SIZE);
-    tid = kthread_create(test_thread, stack);
+    tid = kthread_create(test_thread, stack, 0);
     kthread_join(tid,&status);
 
     tid = kthread_id();
@@ -138,6 +142,748 @@ void Csem_test(char *s){
 
 
 
+// csem_down_many() must wait for all n units, even when they
+// trickle in from several csem_up() calls.
+void Csem_many_test(char *s){
+    struct counting_semaphore csem;
+    int pid, xstatus;
+
+    if(csem_alloc(&csem, 2) == -1){
+        printf("%s: csem_alloc failed\n", s);
+        exit(1);
+    }
+    csem_down_many(&csem, 2);
+    if((pid = fork()) == 0){
+        csem_down_many(&csem, 3);
+        exit(0);
+    }
+    sleep(2);
+    csem_up(&csem);
+    csem_up_many(&csem, 2);
+    wait(&xstatus);
+    csem_free(&csem);
+    if(xstatus != 0){
+        printf("%s: child failed\n", s);
+        exit(1);
+    }
+    if(ksem_down(csem.descriptor, 1) != -1){
+        printf("%s: ksem_down on a freed semaphore succeeded\n", s);
+        exit(1);
+    }
+}
+
+volatile int cow_stop;
+volatile int cow_value;
+
+void cow_writer(){
+    while(!cow_stop)
+        cow_value++;
+    kthread_exit(0);
+}
+
+// fork while another thread keeps writing: each child must keep
+// the value it saw at fork, and the writer must keep going.
+void cow_thread_test(char *s){
+    int tid, pid, i, v, xstatus;
+
+    cow_stop = 0;
+    tid = kthread_create(cow_writer, malloc(MAX_STACK_SIZE), 0);
+    if(tid < 0){
+        printf("%s: kthread_create failed\n", s);
+        exit(1);
+    }
+    for(i = 0; i < 10; i++){
+        if((pid = fork()) < 0){
+            printf("%s: fork failed\n", s);
+            exit(1);
+        }
+        if(pid == 0){
+            v = cow_value;
+            sleep(1);
+            exit(cow_value != v);
+        }
+        wait(&xstatus);
+        if(xstatus != 0){
+            printf("%s: child saw the parent's writes\n", s);
+            exit(1);
+        }
+    }
+    v = cow_value;
+    sleep(1);
+    if(cow_value == v){
+        printf("%s: writer stopped\n", s);
+        exit(1);
+    }
+    cow_stop = 1;
+    kthread_join(tid, &xstatus);
+}
+
+#define LAZY_PAGES 64
+char *lazy_mem;
+
+void lazy_toucher(){
+    int i;
+    for(i = 0; i < LAZY_PAGES; i++)
+        lazy_mem[i * PGSIZE] = 1;
+    kthread_exit(0);
+}
+
+// sbrk() only reserves memory; the pages are faulted in on first
+// touch, once each even if several threads touch them at once.
+void lazy_sbrk_test(char *s){
+    struct sysinfo before, after;
+    int tids[NTHREAD-1];
+    void *stacks[NTHREAD-1];
+    int i, status;
+
+    // fault in the thread stacks up front, so that only
+    // lazy_mem's pages are faulted below.
+    for(i = 0; i < NTHREAD-1; i++){
+        stacks[i] = malloc(MAX_STACK_SIZE);
+        memset(stacks[i], 0, MAX_STACK_SIZE);
+    }
+    sysinfo(&before);
+    lazy_mem = sbrk(LAZY_PAGES * PGSIZE);
+    if(lazy_mem == (char*)-1){
+        printf("%s: sbrk failed\n", s);
+        exit(1);
+    }
+    sysinfo(&after);
+    if(after.lazyreserved - before.lazyreserved != LAZY_PAGES ||
+       after.lazyfaulted != before.lazyfaulted){
+        printf("%s: sbrk mapped pages eagerly\n", s);
+        exit(1);
+    }
+    for(i = 0; i < NTHREAD-1; i++){
+        tids[i] = kthread_create(lazy_toucher, stacks[i], 0);
+        if(tids[i] < 0){
+            printf("%s: kthread_create failed\n", s);
+            exit(1);
+        }
+    }
+    for(i = 0; i < NTHREAD-1; i++)
+        kthread_join(tids[i], &status);
+    sysinfo(&after);
+    if(after.lazyfaulted - before.lazyfaulted != LAZY_PAGES){
+        printf("%s: %d pages faulted, expected %d\n", s,
+               (int)(after.lazyfaulted - before.lazyfaulted), LAZY_PAGES);
+        exit(1);
+    }
+    for(i = 0; i < LAZY_PAGES; i++){
+        if(lazy_mem[i * PGSIZE] != 1 || lazy_mem[i * PGSIZE + 1] != 0){
+            printf("%s: page %d lost a write\n", s, i);
+            exit(1);
+        }
+    }
+    // giving the pages back gives back their reservation too.
+    sbrk(-LAZY_PAGES * PGSIZE);
+    sysinfo(&after);
+    if(after.lazyreserved != before.lazyreserved ||
+       after.lazyfaulted != before.lazyfaulted){
+        printf("%s: %d/%d lazy pages after shrinking, expected %d/%d\n", s,
+               (int)after.lazyfaulted, (int)after.lazyreserved,
+               (int)before.lazyfaulted, (int)before.lazyreserved);
+        exit(1);
+    }
+}
+
+#define TLS_ROUNDS 1000
+
+int tls_counter_key;
+int tls_self_key;
+
+void tls_thread(){
+    int i;
+    TLS(void*, tls_self_key) = tls_self();
+    for(i = 0; i < TLS_ROUNDS; i++){
+        TLS(int, tls_counter_key)++;
+        if(i % 100 == 0)
+            sleep(0); // let the other threads run in between
+    }
+    if(TLS(int, tls_counter_key) != TLS_ROUNDS ||
+       TLS(void*, tls_self_key) != tls_self())
+        kthread_exit(1);
+    kthread_exit(0);
+}
+
+// each thread counts in its own TLS block, including main's,
+// which is set up lazily.
+void tls_test(char *s){
+    int tids[NTHREAD-1];
+    int i, status;
+
+    if((tls_counter_key = tls_key(sizeof(int))) < 0 ||
+       (tls_self_key = tls_key(sizeof(void*))) < 0){
+        printf("%s: tls_key failed\n", s);
+        exit(1);
+    }
+    for(i = 0; i < NTHREAD-1; i++){
+        tids[i] = kthread_create(tls_thread, malloc(MAX_STACK_SIZE), tls_alloc());
+        if(tids[i] < 0){
+            printf("%s: kthread_create failed\n", s);
+            exit(1);
+        }
+    }
+    TLS(int, tls_counter_key) = -1;
+    for(i = 0; i < NTHREAD-1; i++){
+        if(kthread_join(tids[i], &status) < 0 || status != 0){
+            printf("%s: thread %d saw another thread's TLS\n", s, i);
+            exit(1);
+        }
+    }
+    if(TLS(int, tls_counter_key) != -1){
+        printf("%s: main's TLS changed\n", s);
+        exit(1);
+    }
+}
+
+#define MALLOC_THREADS 4
+#define MALLOC_ROUNDS  200
+#define MALLOC_LIVE    16
+
+// threads with and without TLS blocks (so with and without a
+// malloc cache) allocate and free at once; every block must stay
+// theirs until freed.
+void malloc_thread(){
+    char *live[MALLOC_LIVE];
+    int i, j, n, me = kthread_id();
+
+    for(i = 0; i < MALLOC_LIVE; i++)
+        live[i] = 0;
+    for(j = 0; j < MALLOC_ROUNDS; j++){
+        i = j % MALLOC_LIVE;
+        if(live[i]){
+            n = 8 << (i % 9);
+            if(live[i][0] != (char)me || live[i][n-1] != (char)me){
+                printf("malloc_thread: block overwritten\n");
+                kthread_exit(1);
+            }
+            free(live[i]);
+        }
+        n = 8 << (i % 9);
+        if((live[i] = malloc(n)) == 0){
+            printf("malloc_thread: malloc failed\n");
+            kthread_exit(1);
+        }
+        memset(live[i], me, n);
+    }
+    for(i = 0; i < MALLOC_LIVE; i++)
+        free(live[i]);
+    malloc_flush();
+    kthread_exit(0);
+}
+
+void malloc_thread_test(char *s){
+    int tids[MALLOC_THREADS];
+    int i, status;
+
+    for(i = 0; i < MALLOC_THREADS; i++){
+        tids[i] = kthread_create(malloc_thread, malloc(MAX_STACK_SIZE),
+                                 i % 2 ? tls_alloc() : 0);
+        if(tids[i] < 0){
+            printf("%s: kthread_create failed\n", s);
+            exit(1);
+        }
+    }
+    for(i = 0; i < MALLOC_THREADS; i++){
+        if(kthread_join(tids[i], &status) < 0 || status != 0){
+            printf("%s: thread %d failed\n", s, i);
+            exit(1);
+        }
+    }
+}
+
+// recurse depth frames deep, each over 512 bytes; returns depth.
+int spawn_recurse(int depth){
+    volatile char frame[512];
+    frame[0] = 1;
+    if(depth == 0)
+        return 0;
+    return spawn_recurse(depth - 1) + frame[0];
+}
+
+int spawn_deep(void *arg){
+    return spawn_recurse((uint64)arg);
+}
+
+int spawn_fork(void *arg){
+    int pid, xstatus;
+    // the child runs on its copy of this stack
+    if((pid = fork()) == 0)
+        exit(spawn_recurse(16));
+    if(pid < 0 || wait(&xstatus) != pid)
+        return -1;
+    return xstatus;
+}
+
+// kthread_spawn() threads run on kernel-managed stacks: deep
+// recursion works without a malloc'd stack, fork copies the
+// stack, and running off the end kills only that thread.
+void spawn_test(char *s){
+    struct kthread_attr attr;
+    int tid, status;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.stacksize = 256 * 1024;
+    if((tid = kthread_spawn(spawn_deep, (void*)300, &attr)) < 0 ||
+       kthread_join(tid, &status) < 0 || status != 300){
+        printf("%s: deep recursion failed\n", s);
+        exit(1);
+    }
+    if((tid = kthread_spawn(spawn_fork, 0, 0)) < 0 ||
+       kthread_join(tid, &status) < 0 || status != 16){
+        printf("%s: fork from a spawned thread failed\n", s);
+        exit(1);
+    }
+    attr.stacksize = 16 * 1024;
+    if((tid = kthread_spawn(spawn_deep, (void*)1000, &attr)) < 0 ||
+       kthread_join(tid, &status) < 0 || status != -1){
+        printf("%s: stack overflow not caught\n", s);
+        exit(1);
+    }
+}
+
+int detach_worker(void *arg){
+    sleep((uint64)arg % 3);
+    return (uint64)arg;
+}
+
+// detached threads can't be joined and free their slot when they
+// exit; kthread_join_any() reaps the others in any order, once each.
+void detach_test(char *s){
+    int tids[NTHREAD-1], seen[NTHREAD-1];
+    int i, j, tid, status, round;
+
+    for(round = 0; round < 3; round++){
+        for(i = 0; i < NTHREAD-1; i++){
+            if((tids[i] = kthread_spawn(detach_worker, (void*)(uint64)i, 0)) < 0){
+                printf("%s: kthread_spawn failed in round %d\n", s, round);
+                exit(1);
+            }
+            seen[i] = 0;
+            if(i % 2 && kthread_detach(tids[i]) < 0){
+                printf("%s: kthread_detach failed\n", s);
+                exit(1);
+            }
+        }
+        if(kthread_join(tids[1], &status) == 0){
+            printf("%s: joined a detached thread\n", s);
+            exit(1);
+        }
+        for(j = 0; j < (NTHREAD-1+1)/2; j++){
+            if((tid = kthread_join_any(&status)) < 0){
+                printf("%s: kthread_join_any failed\n", s);
+                exit(1);
+            }
+            for(i = 0; i < NTHREAD-1 && tids[i] != tid; i++)
+                ;
+            if(i == NTHREAD-1 || i % 2 || seen[i]++ || status != i){
+                printf("%s: kthread_join_any returned %d\n", s, tid);
+                exit(1);
+            }
+        }
+        if(kthread_join_any(&status) >= 0){
+            printf("%s: kthread_join_any found a thread too many\n", s);
+            exit(1);
+        }
+        sleep(3); // let the detached ones finish
+    }
+}
+
+#define SIGROUTE 12
+
+volatile int route_tid;   // thread the last SIGROUTE handler ran on
+volatile int route_done;
+
+void route_handler(int signum){
+    route_tid = kthread_id();
+}
+
+int route_waiter(void *arg){
+    while(!route_done)
+        sleep(1);
+    return 0;
+}
+
+int route_worker(void *arg){
+    while(!route_done)
+        ;
+    return 0;
+}
+
+int route_wait(void){
+    int i;
+    for(i = 0; route_tid == 0 && i < 100; i++)
+        sleep(1);
+    return route_tid;
+}
+
+// tkill() runs the handler on the thread it names. kill() skips
+// threads that block the signal and picks one in sleep(), which a
+// signal ends, over one that is running.
+void tkill_test(char *s){
+    struct sigaction act = {route_handler, 0};
+    struct sigaction old;
+    int waiter, worker, status;
+    uint mask;
+
+    sigaction(SIGROUTE, &act, &old);
+    mask = sigprocmask(1 << SIGROUTE);
+    route_done = 0;
+    route_tid = 0;
+    if((waiter = kthread_spawn(route_waiter, 0, 0)) < 0 ||
+       (worker = kthread_spawn(route_worker, 0, 0)) < 0){
+        printf("%s: kthread_spawn failed\n", s);
+        exit(1);
+    }
+    sleep(2); // let the waiter get into sleep()
+
+    if(tkill(worker, SIGROUTE) < 0 || route_wait() != worker){
+        printf("%s: tkill ran the handler on %d, not %d\n", s, route_tid, worker);
+        exit(1);
+    }
+    route_tid = 0;
+    if(kill(getpid(), SIGROUTE) < 0){
+        printf("%s: kill failed\n", s);
+        exit(1);
+    }
+    if(route_wait() != waiter){
+        printf("%s: kill ran the handler on %d, not %d\n", s, route_tid, waiter);
+        exit(1);
+    }
+    if(tkill(kthread_id() + 1000, SIGROUTE) == 0){
+        printf("%s: tkill found a thread that does not exist\n", s);
+        exit(1);
+    }
+
+    route_done = 1;
+    kthread_join(waiter, &status);
+    kthread_join(worker, &status);
+    sigprocmask(mask);
+    sigaction(SIGROUTE, &old, 0);
+}
+
+#define SIGQ 13
+#define NQUEUED 16
+
+volatile int q_count, q_sum;
+
+void q_handler(int signum, int value){
+    q_count++;
+    q_sum += value;
+}
+
+// take NQUEUED SIGQs; returns how many came in the order sent.
+int q_waiter(void *arg){
+    struct siginfo info;
+    int i, inorder = 0;
+
+    for(i = 0; i < NQUEUED; i++){
+        if(sigwaitinfo(1 << SIGQ, &info) != SIGQ)
+            return -1;
+        if(info.si_signo == SIGQ && info.si_value == i && info.si_pid == getpid())
+            inorder++;
+    }
+    return inorder;
+}
+
+// sigqueue()'d signals are not merged and carry their values, to
+// a thread in sigwaitinfo() or to a handler.
+void sigqueue_test(char *s){
+    struct sigaction act = {(void (*)(int))q_handler, 0};
+    struct sigaction old;
+    struct siginfo info;
+    int tid, status, i;
+    uint mask;
+
+    mask = sigprocmask(1 << SIGQ);
+    if((tid = kthread_spawn(q_waiter, 0, 0)) < 0){
+        printf("%s: kthread_spawn failed\n", s);
+        exit(1);
+    }
+    for(i = 0; i < NQUEUED; i++){
+        if(sigqueue(getpid(), SIGQ, i) < 0){
+            printf("%s: sigqueue failed\n", s);
+            exit(1);
+        }
+    }
+    if(kthread_join(tid, &status) < 0 || status != NQUEUED){
+        printf("%s: sigwaitinfo got %d of %d in order\n", s, status, NQUEUED);
+        exit(1);
+    }
+    if(sigtimedwait(1 << SIGQ, &info, 2) != -1){
+        printf("%s: sigtimedwait took a signal nobody sent\n", s);
+        exit(1);
+    }
+
+    sigaction(SIGQ, &act, &old);
+    sigprocmask(mask);
+    q_count = q_sum = 0;
+    for(i = 1; i <= 3; i++)
+        sigqueue(getpid(), SIGQ, i);
+    if(q_count != 3 || q_sum != 6){
+        printf("%s: handler ran %d times, values sum to %d\n", s, q_count, q_sum);
+        exit(1);
+    }
+    sigaction(SIGQ, &old, 0);
+}
+
+int prio_thread(void *arg){
+    return getpriority(0);
+}
+
+// setpriority() checks its level and thread, and threads made by
+// kthread_spawn() and fork() start at their creator's level.
+void priority_test(char *s){
+    int tid, pid, status;
+
+    if(getpriority(0) != 0){
+        printf("%s: started at level %d\n", s, getpriority(0));
+        exit(1);
+    }
+    if(setpriority(0, NPRIO) >= 0 || setpriority(0, -1) >= 0){
+        printf("%s: set a level that does not exist\n", s);
+        exit(1);
+    }
+    if(setpriority(-1, 0) >= 0 || getpriority(-1) >= 0){
+        printf("%s: found a thread that does not exist\n", s);
+        exit(1);
+    }
+    if(setpriority(0, NPRIO-1) < 0 || getpriority(0) != NPRIO-1){
+        printf("%s: setpriority failed\n", s);
+        exit(1);
+    }
+    if((tid = kthread_spawn(prio_thread, 0, 0)) < 0){
+        printf("%s: kthread_spawn failed\n", s);
+        exit(1);
+    }
+    if(kthread_join(tid, &status) < 0 || status != NPRIO-1){
+        printf("%s: thread ran at level %d\n", s, status);
+        exit(1);
+    }
+    if((pid = fork()) < 0){
+        printf("%s: fork failed\n", s);
+        exit(1);
+    }
+    if(pid == 0)
+        exit(getpriority(0));
+    if(wait(&status) != pid || status != NPRIO-1){
+        printf("%s: child ran at level %d\n", s, status);
+        exit(1);
+    }
+    setpriority(0, 0);
+}
+
+#define NSTOPPED 60
+#define STOP_TICKS 20
+
+// spin for ticks clock ticks; returns how much work got done.
+int stop_spin(int ticks){
+    volatile int i;
+    int n = 0, end = uptime() + ticks;
+
+    while(uptime() < end){
+        for(i = 0; i < 1000; i++)
+            ;
+        n++;
+    }
+    return n;
+}
+
+// stopped processes sleep until SIGCONT instead of yielding, so
+// NSTOPPED of them leave a CPU-bound job's throughput alone.
+void stop_test(char *s){
+    int pids[NSTOPPED];
+    int i, base, n, deadline, xstatus;
+
+    base = stop_spin(STOP_TICKS);
+    deadline = uptime() + 2*STOP_TICKS + 10;
+    for(i = 0; i < NSTOPPED; i++){
+        if((pids[i] = fork()) < 0){
+            printf("%s: fork failed\n", s);
+            exit(1);
+        }
+        if(pids[i] == 0){
+            while(uptime() < deadline)
+                ;
+            exit(0);
+        }
+        kill(pids[i], SIGSTOP);
+    }
+    sleep(1); // let any that had not run yet stop
+    n = stop_spin(STOP_TICKS);
+    printf("%d/%d of the work with %d stopped ... ", n, base, NSTOPPED);
+    if(n < base / 2){
+        printf("%s: stopped processes slowed the job down\n", s);
+        exit(1);
+    }
+
+    while(uptime() < deadline)
+        sleep(1);
+    for(i = 0; i < NSTOPPED; i++)
+        kill(pids[i], SIGCONT);
+    for(i = 0; i < NSTOPPED; i++){
+        if(wait(&xstatus) < 0 || xstatus != 0){
+            printf("%s: a continued process did not finish\n", s);
+            exit(1);
+        }
+    }
+}
+
+#define MANY_THREADS 24  // more than fit in one trapframe page
+
+struct usem many_gate;
+
+void many_thread(){
+    usem_down(&many_gate);
+    kthread_exit(kthread_id());
+}
+
+// raise the thread limit past the old NTHREAD=8 layout and fill it;
+// the trapframe region grows a page past the first.
+void many_threads_test(char *s){
+    int tids[MANY_THREADS];
+    int i, status, old;
+
+    usem_init(&many_gate, 0);
+    if((old = kthread_limit(MANY_THREADS)) < 0){
+        printf("%s: kthread_limit failed\n", s);
+        exit(1);
+    }
+    for(i = 0; i < MANY_THREADS-1; i++){
+        tids[i] = kthread_create(many_thread, malloc(MAX_STACK_SIZE), 0);
+        if(tids[i] < 0){
+            printf("%s: kthread_create %d failed\n", s, i);
+            exit(1);
+        }
+    }
+    if(kthread_create(many_thread, malloc(MAX_STACK_SIZE), 0) >= 0){
+        printf("%s: created a thread past the limit\n", s);
+        exit(1);
+    }
+    if(kthread_limit(MANY_THREADS-1) >= 0){
+        printf("%s: limit dropped below live threads\n", s);
+        exit(1);
+    }
+    for(i = 0; i < MANY_THREADS-1; i++)
+        usem_up(&many_gate);
+    for(i = 0; i < MANY_THREADS-1; i++){
+        if(kthread_join(tids[i], &status) < 0 || status != tids[i]){
+            printf("%s: join %d failed\n", s, i);
+            exit(1);
+        }
+    }
+    kthread_limit(old);
+}
+
+#define SLAB_PIPES 6  // NOFILE allows 6 pipes next to fds 0-2
+
+// find the slab cache called name; -1 if there is none.
+int slab_find(char *name, struct slabstat *st){
+    int i;
+    for(i = 0; slabstat(i, st) == 0; i++)
+        if(strcmp(st->name, name) == 0)
+            return i;
+    return -1;
+}
+
+// pipes come from the "pipe" slab cache, several to a page.
+void slab_pipe_test(char *s){
+    struct slabstat before, during, after;
+    int fds[SLAB_PIPES][2];
+    int i;
+
+    if(slab_find("pipe", &before) < 0){
+        printf("%s: no pipe cache\n", s);
+        exit(1);
+    }
+    for(i = 0; i < SLAB_PIPES; i++){
+        if(pipe(fds[i]) < 0){
+            printf("%s: pipe failed\n", s);
+            exit(1);
+        }
+    }
+    slab_find("pipe", &during);
+    if(during.inuse - before.inuse != SLAB_PIPES ||
+       during.slabs * during.perslab < during.inuse ||
+       during.slabs - before.slabs >= SLAB_PIPES){
+        printf("%s: %d pipes in use in %d slabs\n", s,
+               (int)during.inuse, (int)during.slabs);
+        exit(1);
+    }
+    for(i = 0; i < SLAB_PIPES; i++){
+        close(fds[i][0]);
+        close(fds[i][1]);
+    }
+    slab_find("pipe", &after);
+    if(after.inuse != before.inuse){
+        printf("%s: %d pipes leaked\n", s, (int)(after.inuse - before.inuse));
+        exit(1);
+    }
+}
+
+#define USYNC_THREADS (NTHREAD-1)
+#define USYNC_ROUNDS  1000
+
+struct umutex usync_mutex;
+struct usem usync_sem;
+struct ucond usync_cond;
+int usync_counter;
+int usync_done;
+
+void usync_thread(){
+    int i;
+    for(i = 0; i < USYNC_ROUNDS; i++){
+        umutex_lock(&usync_mutex);
+        usync_counter++;
+        umutex_unlock(&usync_mutex);
+        usem_up(&usync_sem);
+    }
+    umutex_lock(&usync_mutex);
+    usync_done++;
+    ucond_signal(&usync_cond);
+    umutex_unlock(&usync_mutex);
+    kthread_exit(0);
+}
+
+// threads of one process hammer the futex-based mutex, semaphore
+// and condition variable.
+void usync_test(char *s){
+    int tids[USYNC_THREADS];
+    int i, status;
+
+    umutex_init(&usync_mutex);
+    usem_init(&usync_sem, 0);
+    ucond_init(&usync_cond);
+    for(i = 0; i < USYNC_THREADS; i++){
+        tids[i] = kthread_create(usync_thread, malloc(MAX_STACK_SIZE), 0);
+        if(tids[i] < 0){
+            printf("%s: kthread_create failed\n", s);
+            exit(1);
+        }
+    }
+    // one down per up, or we sleep here forever.
+    for(i = 0; i < USYNC_THREADS * USYNC_ROUNDS; i++)
+        usem_down(&usync_sem);
+
+    umutex_lock(&usync_mutex);
+    while(usync_done < USYNC_THREADS)
+        ucond_wait(&usync_cond, &usync_mutex);
+    umutex_unlock(&usync_mutex);
+
+    for(i = 0; i < USYNC_THREADS; i++)
+        kthread_join(tids[i], &status);
+    if(usync_counter != USYNC_THREADS * USYNC_ROUNDS){
+        printf("%s: counter %d, expected %d\n", s, usync_counter,
+               USYNC_THREADS * USYNC_ROUNDS);
+        exit(1);
+    }
+    if(futex(&usync_counter, FUTEX_WAIT, usync_counter + 1) != -1){
+        printf("%s: futex wait on a stale value slept\n", s);
+        exit(1);
+    }
+}
+
 // what if you pass ridiculous pointers to system calls
 // that read user memory with copyin?
 void
@@ -2888,6 +3634,20 @@ main(int argc, char *argv[])
 	  {thread_test,"thread_test"},
 	  {bsem_test,"bsem_test"},
 	  {Csem_test,"Csem_test"},
+	  {Csem_many_test,"Csem_many_test"},
+	  {usync_test,"usync_test"},
+	  {cow_thread_test,"cow_thread_test"},
+	  {lazy_sbrk_test,"lazy_sbrk_test"},
+	  {slab_pipe_test,"slab_pipe_test"},
+	  {many_threads_test,"many_threads_test"},
+	  {tls_test,"tls_test"},
+	  {malloc_thread_test,"malloc_thread_test"},
+	  {spawn_test,"spawn_test"},
+	  {detach_test,"detach_test"},
+	  {tkill_test,"tkill_test"},
+	  {stop_test,"stop_test"},
+	  {sigqueue_test,"sigqueue_test"},
+	  {priority_test,"priority_test"},
 	  
 // ASS 1 tests
 //	{stracetest,"stracetest"},    //18 ticks, need to compare inputs
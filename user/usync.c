@@ -0,0 +1,113 @@
+#include "kernel/types.h"
+#include "kernel/futex.h"
+#include "user/user.h"
+#include "user/usync.h"
+
+//
+// Mutex, counting semaphore and condition variable built on
+// futex(). The mutex is the usual three-state futex lock: the
+// unlocker only calls into the kernel when the state says a
+// waiter may be asleep.
+//
+
+void
+umutex_init(struct umutex *m)
+{
+  m->state = 0;
+}
+
+void
+umutex_lock(struct umutex *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(&m->state, 0, 1)) == 0)
+    return;
+  // contended: advertise a waiter, then sleep until we are the
+  // ones who swap it from unlocked.
+  if(c != 2)
+    c = __sync_lock_test_and_set(&m->state, 2);
+  while(c != 0){
+    futex(&m->state, FUTEX_WAIT, 2);
+    c = __sync_lock_test_and_set(&m->state, 2);
+  }
+}
+
+void
+umutex_unlock(struct umutex *m)
+{
+  if(__sync_fetch_and_sub(&m->state, 1) != 1){
+    m->state = 0;
+    __sync_synchronize();
+    futex(&m->state, FUTEX_WAKE, 1);
+  }
+}
+
+void
+usem_init(struct usem *s, int value)
+{
+  s->value = value;
+  s->waiters = 0;
+}
+
+void
+usem_down(struct usem *s)
+{
+  int v;
+
+  for(;;){
+    v = s->value;
+    if(v > 0){
+      if(__sync_bool_compare_and_swap(&s->value, v, v - 1))
+        return;
+      continue;
+    }
+    // register before sleeping so usem_up() knows to wake us;
+    // futex() returns at once if an up already landed.
+    __sync_fetch_and_add(&s->waiters, 1);
+    futex(&s->value, FUTEX_WAIT, 0);
+    __sync_fetch_and_sub(&s->waiters, 1);
+  }
+}
+
+void
+usem_up(struct usem *s)
+{
+  __sync_fetch_and_add(&s->value, 1);
+  if(s->waiters > 0)
+    futex(&s->value, FUTEX_WAKE, 1);
+}
+
+void
+ucond_init(struct ucond *c)
+{
+  c->seq = 0;
+}
+
+// m must be held; it is held again on return. Like any
+// condition variable, wakeups can be spurious.
+void
+ucond_wait(struct ucond *c, struct umutex *m)
+{
+  int seq = c->seq;
+
+  umutex_unlock(m);
+  futex(&c->seq, FUTEX_WAIT, seq);
+  // relock as contended: other waiters may have been woken too.
+  while(__sync_lock_test_and_set(&m->state, 2) != 0)
+    futex(&m->state, FUTEX_WAIT, 2);
+}
+
+void
+ucond_signal(struct ucond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex(&c->seq, FUTEX_WAKE, 1);
+}
+
+void
+ucond_broadcast(struct ucond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex(&c->seq, FUTEX_WAKE, -1);
+}
@@ -0,0 +1,29 @@
+// User-space synchronization on top of futex(). The uncontended
+// paths are a single atomic instruction; only a thread that has
+// to wait (or has to wake a waiter) enters the kernel.
+
+struct umutex {
+  volatile int state;   // 0 unlocked, 1 locked, 2 locked and maybe waiters
+};
+
+struct usem {
+  volatile int value;   // never negative
+  volatile int waiters; // threads in (or about to be in) futex wait
+};
+
+struct ucond {
+  volatile int seq;     // bumped by every signal/broadcast
+};
+
+void umutex_init(struct umutex*);
+void umutex_lock(struct umutex*);
+void umutex_unlock(struct umutex*);
+
+void usem_init(struct usem*, int);
+void usem_down(struct usem*);
+void usem_up(struct usem*);
+
+void ucond_init(struct ucond*);
+void ucond_wait(struct ucond*, struct umutex*);
+void ucond_signal(struct ucond*);
+void ucond_broadcast(struct ucond*);
@@ -47,3 +47,21 @@ entry("bsem_alloc");
 entry("bsem_free");
 entry("bsem_down");
 entry("bsem_up");
+entry("sysinfo");
+entry("futex");
+entry("ksem_alloc");
+entry("ksem_free");
+entry("ksem_down");
+entry("ksem_up");
+entry("bsem_stat");
+entry("bsem_sethandoff");
+entry("slabstat");
+entry("kthread_limit");
+entry("kthread_run");
+entry("kthread_detach");
+entry("kthread_join_any");
+entry("tkill");
+entry("sigqueue");
+entry("sigtimedwait");
+entry("setpriority");
+entry("getpriority");
@@ -0,0 +1,84 @@
+#include "kernel/types.h"
+#include "kernel/kthread.h"
+#include "user/user.h"
+
+// Thread-local storage. Every thread's tp register points at its
+// own TLS_SIZE-byte block: kthread_create() loads the block it is
+// given, and a thread started without one (like main) gets one
+// on its first tls_self(). kthread_spawn() threads free that one
+// as they exit; nothing else does, so a kthread_create() thread
+// that uses TLS should be given a tls_alloc() block, which its
+// creator frees after the join.
+static int tls_used;
+
+// A zeroed TLS block to pass to kthread_create().
+void *
+tls_alloc(void)
+{
+  void *b;
+
+  if((b = malloc(TLS_SIZE)) != 0)
+    memset(b, 0, TLS_SIZE);
+  return b;
+}
+
+// The calling thread's TLS block.
+void *
+tls_self(void)
+{
+  void *b;
+
+  asm volatile("mv %0, tp" : "=r" (b));
+  if(b == 0){
+    if((b = tls_alloc()) == 0){
+      printf("tls_self: out of memory\n");
+      exit(1);
+    }
+    asm volatile("mv tp, %0" : : "r" (b));
+  }
+  return b;
+}
+
+// Reserve size bytes in every thread's TLS block, for TLS().
+// Returns their offset, or -1 if the blocks are full.
+int
+tls_key(uint size)
+{
+  int key;
+
+  size = (size + 7) & ~7;
+  key = __sync_fetch_and_add(&tls_used, size);
+  if(key + size > TLS_SIZE)
+    return -1;
+  return key;
+}
+
+// Where threads made by kthread_spawn() start: run fn(arg), hand
+// the malloc cache back and exit with fn's return value. A TLS
+// block tls_self() made along the way is freed here too.
+static void
+kthread_start(int (*fn)(void*), void *arg)
+{
+  void *given, *tls;
+  int status;
+
+  asm volatile("mv %0, tp" : "=r" (given));
+  status = fn(arg);
+  malloc_flush();
+  asm volatile("mv %0, tp" : "=r" (tls));
+  if(tls != given){
+    // clear tp first, so free() doesn't make a new cache.
+    asm volatile("mv tp, zero");
+    free(tls);
+  }
+  kthread_exit(status);
+}
+
+// Start a thread running fn(arg) on a stack the kernel maps, with
+// a guard below it; attr (or 0 for the defaults) gives the stack
+// size and TLS block. Returns the thread id, or -1.
+int
+kthread_spawn(int (*fn)(void*), void *arg, struct kthread_attr *attr)
+{
+  return kthread_run((void (*)())kthread_start, fn, arg, attr);
+}